@@ -0,0 +1,15 @@
+TEMPLATE = app
+
+CONFIG += console c++17
+CONFIG -= app_bundle
+CONFIG -= qt
+
+SOURCES += \
+        main.cpp
+
+# Стример из SarganYOLO: измеряется тот же код, что работает в приложении
+INCLUDEPATH += ../SarganYOLO
+
+unix {
+    LIBS += -pthread
+}
@@ -0,0 +1,485 @@
+// ============================================================================
+// Нагрузочный тест стримера
+//   Сервер публикует синтетические JPEG-кадры заданного размера и частоты,
+//   дочерний процесс открывает к нему заданное число HTTP-клиентов, часть из
+//   которых читает медленно или запрашивает меньшую частоту. Отчет: FPS, пропуски кадров и задержка для
+//   каждого клиента, загрузка процессора сервером. Для клиентов с ?fps= пропуски по ограничению
+//   частоты (skipped) отделены от недостачи кадров относительно запрошенной частоты (missed).
+//
+//   ./SarganBench --clients=100 --slow=10 --paced=20 --fps=30 --frame-size=60000 --zerocopy=16384
+// ============================================================================
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+// ============================================================================
+// Подключаем библиотеки стримера
+#include "nadjieb/streamer.hpp"
+using MJPEGStreamer = nadjieb::MJPEGStreamer;
+// ============================================================================
+using Clock = std::chrono::steady_clock;
+
+/** Параметры теста */
+struct BenchOptions
+{
+    int port = 8090;
+    int clients = 10;          // Всего клиентов
+    int slow = 0;              // Из них медленных
+    int slow_rate = 100;       // Скорость чтения медленного клиента, КБ/с
+    int paced = 0;             // Клиентов с ограничением частоты (?fps=)
+    int paced_fps = 2;         // Запрашиваемая ими частота кадров
+    int frame_size = 50000;    // Размер кадра, байт
+    int fps = 30;              // Частота публикации
+    int duration = 10;         // Длительность измерения, с
+    int workers = 2;           // Потоки отправки стримера
+    int listeners = 1;         // Потоки приема соединений
+    int send_buffer = 0;       // SO_SNDBUF соединений стримера, 0 - по умолчанию
+    int zerocopy = 0;          // Порог MSG_ZEROCOPY, байт, 0 - выключено
+    std::string csv;           // Файл для отчета по клиентам
+};
+
+/** Тип клиента: читает без задержек, читает медленно, запрашивает ?fps= */
+enum ClientKind { CLIENT_FAST, CLIENT_SLOW, CLIENT_PACED };
+static const char *CLIENT_KIND_NAMES[] = {"fast", "slow", "paced"};
+
+/** Результаты одного клиента */
+struct ClientStats
+{
+    ClientKind kind = CLIENT_FAST;
+    bool connected = false;
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+    uint64_t missed = 0;              // Пропущенные номера кадров; для paced - недостача до ?fps=
+    uint64_t skipped = 0;             // Пропущенные по ограничению частоты (paced)
+    double fps = 0;
+    double max_gap_ms = 0;            // Наибольший интервал между кадрами
+    std::vector<double> latency_ms;   // От публикации до получения кадра
+};
+
+// Синтетический кадр: SOI, комментарий с номером кадра и временем публикации,
+// заполнитель, EOI. Часы steady_clock общие для процессов (CLOCK_MONOTONIC).
+static const size_t STAMP_OFFSET = 6;
+static const size_t STAMP_SIZE = 16;
+
+static std::string make_frame(uint64_t seq, size_t frame_size)
+{
+    frame_size = std::max(frame_size, STAMP_OFFSET + STAMP_SIZE + 2);
+    std::string frame(frame_size, (char)(seq & 0x7F));
+    const uint8_t head[STAMP_OFFSET] = {0xFF, 0xD8, 0xFF, 0xFE, 0x00, 2 + STAMP_SIZE};
+    memcpy(&frame[0], head, sizeof(head));
+    uint64_t now = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       Clock::now().time_since_epoch()).count();
+    memcpy(&frame[STAMP_OFFSET], &seq, 8);
+    memcpy(&frame[STAMP_OFFSET + 8], &now, 8);
+    frame[frame_size - 2] = (char)0xFF;
+    frame[frame_size - 1] = (char)0xD9;
+    return frame;
+}
+
+static double percentile(std::vector<double> values, double p)
+{
+    if (values.empty())
+        return 0;
+    std::sort(values.begin(), values.end());
+    size_t index = (size_t)(p * (values.size() - 1) + 0.5);
+    return values[index];
+}
+
+static double cpu_seconds(const rusage &usage)
+{
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6
+         + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+// Подключение к потоку; сервер может еще не слушать порт.
+static int open_stream(const BenchOptions &options, ClientKind kind, Clock::time_point deadline, std::string &rest)
+{
+    while (Clock::now() < deadline)
+    {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0)
+            return -1;
+
+        if (kind == CLIENT_SLOW)
+        {
+            // Маленький буфер приема, чтобы медленное чтение доходило до сервера
+            int size = 16 * 1024;
+            setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        }
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((uint16_t)options.port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        if (connect(fd, (sockaddr *)&addr, sizeof(addr)) == 0)
+        {
+            std::string path = "/bench";
+            if (kind == CLIENT_PACED)
+                path += "?fps=" + std::to_string(options.paced_fps);
+            std::string request = "GET " + path + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+            send(fd, request.data(), request.size(), MSG_NOSIGNAL);
+
+            // Заголовок ответа
+            std::string response;
+            char buf[4096];
+            size_t end;
+            while ((end = response.find("\r\n\r\n")) == std::string::npos)
+            {
+                ssize_t n = recv(fd, buf, sizeof(buf), 0);
+                if (n <= 0)
+                    break;
+                response.append(buf, n);
+            }
+
+            if (end != std::string::npos && response.compare(0, 12, "HTTP/1.1 200") == 0)
+            {
+                rest = response.substr(end + 4);
+                return fd;
+            }
+        }
+
+        close(fd);
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    return -1;
+}
+
+static void run_client(const BenchOptions &options, ClientStats &stats,
+                       Clock::time_point start, Clock::time_point deadline)
+{
+    std::string data;
+    int fd = open_stream(options, stats.kind, deadline, data);
+    if (fd < 0)
+        return;
+    stats.connected = true;
+
+    timeval timeout{0, 100000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    // Медленный клиент читает не больше slow_rate КБ/с порциями по 10 мс
+    bool slow = stats.kind == CLIENT_SLOW;
+    size_t chunk = slow ? std::max<size_t>(options.slow_rate * 1024 / 100, 1) : 64 * 1024;
+    std::vector<char> buf(chunk);
+
+    Clock::time_point first_frame;
+    Clock::time_point last_frame;
+    uint64_t last_seq = 0;
+    size_t length = 0;   // Длина текущего кадра, 0 - ждем заголовок части
+
+    while (Clock::now() < deadline)
+    {
+        ssize_t n = recv(fd, buf.data(), buf.size(), 0);
+        if (n == 0)
+            break;
+        if (n < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                continue;
+            break;
+        }
+        data.append(buf.data(), n);
+        stats.bytes += n;
+
+        while (true)
+        {
+            if (length == 0)
+            {
+                size_t end = data.find("\r\n\r\n");
+                if (end == std::string::npos)
+                    break;
+                size_t field = data.find("Content-Length: ");
+                if (field == std::string::npos || field > end)
+                {
+                    data.erase(0, end + 4);
+                    continue;
+                }
+                length = strtoul(data.c_str() + field + 16, nullptr, 10);
+                data.erase(0, end + 4);
+                if (length == 0)
+                    continue;
+            }
+
+            if (data.size() < length)
+                break;
+
+            auto now = Clock::now();
+            if (length >= STAMP_OFFSET + STAMP_SIZE && now >= start)
+            {
+                uint64_t seq, stamp;
+                memcpy(&seq, &data[STAMP_OFFSET], 8);
+                memcpy(&stamp, &data[STAMP_OFFSET + 8], 8);
+                auto published = Clock::time_point(std::chrono::nanoseconds(stamp));
+
+                if (stats.frames == 0)
+                    first_frame = now;
+                else
+                {
+                    // Клиенту с ?fps= стример намеренно отдает не каждый кадр
+                    if (seq > last_seq + 1)
+                        (stats.kind == CLIENT_PACED ? stats.skipped : stats.missed) += seq - last_seq - 1;
+                    stats.max_gap_ms = std::max(stats.max_gap_ms,
+                        std::chrono::duration<double, std::milli>(now - last_frame).count());
+                }
+                stats.latency_ms.push_back(std::chrono::duration<double, std::milli>(now - published).count());
+                last_seq = seq;
+                last_frame = now;
+                ++stats.frames;
+            }
+
+            data.erase(0, length);
+            length = 0;
+        }
+
+        if (slow)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    close(fd);
+
+    if (stats.frames > 1)
+        stats.fps = (stats.frames - 1) / std::chrono::duration<double>(last_frame - first_frame).count();
+
+    // Недостача относительно запрошенной частоты за время измерения
+    if (stats.kind == CLIENT_PACED)
+    {
+        auto expected = (uint64_t)(std::min(options.paced_fps, options.fps) * options.duration);
+        stats.missed = expected > stats.frames ? expected - stats.frames : 0;
+    }
+}
+
+// Клиенты в отдельном процессе: его процессорное время не смешивается с серверным.
+static int run_clients(const BenchOptions &options)
+{
+    // Первая секунда - на подключение всех клиентов
+    auto start = Clock::now() + std::chrono::seconds(1);
+    auto deadline = start + std::chrono::seconds(options.duration);
+
+    std::vector<ClientStats> stats(options.clients);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < options.clients; ++i)
+    {
+        if (i < options.slow)
+            stats[i].kind = CLIENT_SLOW;
+        else if (i < options.slow + options.paced)
+            stats[i].kind = CLIENT_PACED;
+        threads.emplace_back(run_client, std::cref(options), std::ref(stats[i]), start, deadline);
+    }
+    for (auto &thread : threads)
+        thread.join();
+
+    std::ofstream csv;
+    if (!options.csv.empty())
+    {
+        csv.open(options.csv);
+        csv << "client,kind,frames,fps,missed,skipped,max_gap_ms,latency_p50_ms,latency_p99_ms,latency_max_ms,bytes\n";
+    }
+
+    printf("%6s %5s %7s %7s %7s %7s %9s %9s %9s %9s\n",
+           "client", "kind", "frames", "fps", "missed", "skipped", "gap_ms", "p50_ms", "p99_ms", "max_ms");
+
+    // Итоги по типам клиентов
+    struct KindSummary
+    {
+        int count = 0;
+        double fps = 0;
+        double min_fps = 0;
+        uint64_t missed = 0;
+        uint64_t skipped = 0;
+        uint64_t bytes = 0;
+        std::vector<double> latency_ms;
+    } summary[3];
+    int failed = 0;
+
+    for (int i = 0; i < options.clients; ++i)
+    {
+        const auto &s = stats[i];
+        const char *kind = CLIENT_KIND_NAMES[s.kind];
+        if (!s.connected)
+        {
+            ++failed;
+            printf("%6d %5s   not connected\n", i, kind);
+            continue;
+        }
+
+        double p50 = percentile(s.latency_ms, 0.5);
+        double p99 = percentile(s.latency_ms, 0.99);
+        double max = percentile(s.latency_ms, 1.0);
+        printf("%6d %5s %7llu %7.1f %7llu %7llu %9.1f %9.1f %9.1f %9.1f\n", i, kind,
+               (unsigned long long)s.frames, s.fps, (unsigned long long)s.missed, (unsigned long long)s.skipped,
+               s.max_gap_ms, p50, p99, max);
+        if (csv.is_open())
+            csv << i << ',' << kind << ',' << s.frames << ',' << s.fps << ',' << s.missed << ',' << s.skipped << ','
+                << s.max_gap_ms << ',' << p50 << ',' << p99 << ',' << max << ',' << s.bytes << '\n';
+
+        auto &sum = summary[s.kind];
+        sum.min_fps = sum.count == 0 ? s.fps : std::min(sum.min_fps, s.fps);
+        ++sum.count;
+        sum.fps += s.fps;
+        sum.missed += s.missed;
+        sum.skipped += s.skipped;
+        sum.bytes += s.bytes;
+        sum.latency_ms.insert(sum.latency_ms.end(), s.latency_ms.begin(), s.latency_ms.end());
+    }
+
+    // Итог по строке на тип для сравнения с базовым прогоном
+    printf("clients: fast=%d slow=%d paced=%d failed=%d\n",
+           summary[CLIENT_FAST].count, summary[CLIENT_SLOW].count, summary[CLIENT_PACED].count, failed);
+    for (int kind = CLIENT_FAST; kind <= CLIENT_PACED; ++kind)
+    {
+        const auto &sum = summary[kind];
+        if (sum.count == 0)
+            continue;
+        printf("%s: fps_avg=%.2f fps_min=%.2f missed=%llu skipped=%llu kb_per_client=%llu"
+               " latency_p50=%.2f latency_p99=%.2f latency_max=%.2f\n",
+               CLIENT_KIND_NAMES[kind], sum.fps / sum.count, sum.min_fps, (unsigned long long)sum.missed,
+               (unsigned long long)sum.skipped,
+               (unsigned long long)(sum.bytes / sum.count / 1024), percentile(sum.latency_ms, 0.5),
+               percentile(sum.latency_ms, 0.99), percentile(sum.latency_ms, 1.0));
+    }
+    fflush(stdout);
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static bool parse_option(const char *arg, const char *name, int &value)
+{
+    size_t length = strlen(name);
+    if (strncmp(arg, name, length) != 0 || arg[length] != '=')
+        return false;
+    value = atoi(arg + length + 1);
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    BenchOptions options;
+    for (int i = 1; i < argc; ++i)
+    {
+        const char *arg = argv[i];
+        if (parse_option(arg, "--port", options.port) ||
+            parse_option(arg, "--clients", options.clients) ||
+            parse_option(arg, "--slow", options.slow) ||
+            parse_option(arg, "--slow-rate", options.slow_rate) ||
+            parse_option(arg, "--paced", options.paced) ||
+            parse_option(arg, "--paced-fps", options.paced_fps) ||
+            parse_option(arg, "--frame-size", options.frame_size) ||
+            parse_option(arg, "--fps", options.fps) ||
+            parse_option(arg, "--duration", options.duration) ||
+            parse_option(arg, "--workers", options.workers) ||
+            parse_option(arg, "--listeners", options.listeners) ||
+            parse_option(arg, "--send-buffer", options.send_buffer) ||
+            parse_option(arg, "--zerocopy", options.zerocopy))
+            continue;
+        if (strncmp(arg, "--csv=", 6) == 0)
+        {
+            options.csv = arg + 6;
+            continue;
+        }
+
+        std::cerr << "Usage: " << argv[0]
+                  << " [--clients=N] [--slow=N] [--slow-rate=KB/s] [--paced=N] [--paced-fps=N]"
+                     " [--frame-size=bytes] [--fps=N]"
+                     " [--duration=s] [--workers=N] [--listeners=N] [--send-buffer=bytes] [--zerocopy=bytes]"
+                     " [--port=N] [--csv=file]" << std::endl;
+        return EXIT_FAILURE;
+    }
+    options.clients = std::max(options.clients, 0);
+    options.slow = std::min(std::max(options.slow, 0), options.clients);
+    options.paced = std::min(std::max(options.paced, 0), options.clients - options.slow);
+    options.paced_fps = std::max(options.paced_fps, 1);
+    options.fps = std::max(options.fps, 1);
+    options.duration = std::max(options.duration, 1);
+
+    // Ответ на рукопожатие WebSocket для примера ключа из RFC 6455, раздел 1.3:
+    // с неверным значением браузеры отклоняют подключение
+    if (nadjieb::net::computeWebSocketAccept("dGhlIHNhbXBsZSBub25jZQ==") != "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=")
+    {
+        std::cerr << "Sec-WebSocket-Accept does not match RFC 6455" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "clients: " << options.clients << " (slow " << options.slow << " at "
+              << options.slow_rate << " KB/s, paced " << options.paced << " at "
+              << options.paced_fps << " fps), frame: " << options.frame_size << " bytes at "
+              << options.fps << " fps, duration: " << options.duration << " s, workers: "
+              << options.workers << ", listeners: " << options.listeners << ", zerocopy: "
+              << options.zerocopy << std::endl;
+
+    // Процесс клиентов создается до запуска потоков стримера
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("fork");
+        return EXIT_FAILURE;
+    }
+    if (pid == 0)
+        _exit(run_clients(options));
+
+    MJPEGStreamer streamer;
+    if (options.send_buffer > 0)
+        streamer.setSendBufferSize(options.send_buffer);
+    if (options.zerocopy > 0)
+        streamer.setZeroCopyThreshold((size_t)options.zerocopy);
+    streamer.start(options.port, options.workers, options.listeners);
+    streamer.createTopic("/bench");
+
+    // Публикация на время подключения, измерения и еще полсекунды
+    auto start = Clock::now();
+    auto measure = start + std::chrono::seconds(1);
+    auto end = measure + std::chrono::seconds(options.duration) + std::chrono::milliseconds(500);
+    auto interval = std::chrono::nanoseconds(1000000000LL / options.fps);
+
+    rusage usage_begin{}, usage_end{};
+    Clock::time_point cpu_begin;
+    bool measuring = false;
+    uint64_t seq = 0, encoded = 0;
+
+    auto next = start;
+    while (Clock::now() < end && streamer.isRunning())
+    {
+        if (!measuring && Clock::now() >= measure)
+        {
+            getrusage(RUSAGE_SELF, &usage_begin);
+            cpu_begin = Clock::now();
+            measuring = true;
+        }
+
+        ++seq;
+        // Как в SarganYOLO: кадр формируется только при наличии зрителей
+        streamer.publish("/bench", [&]() {
+            ++encoded;
+            return make_frame(seq, (size_t)options.frame_size);
+        });
+
+        next += interval;
+        std::this_thread::sleep_until(next);
+    }
+    getrusage(RUSAGE_SELF, &usage_end);
+    double wall = std::chrono::duration<double>(Clock::now() - cpu_begin).count();
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    streamer.stop();
+
+    double cpu = cpu_seconds(usage_end) - cpu_seconds(usage_begin);
+    printf("server: published=%llu encoded=%llu cpu=%.2fs cpu_load=%.1f%% max_rss=%ldKB\n",
+           (unsigned long long)seq, (unsigned long long)encoded, cpu,
+           wall > 0 ? 100.0 * cpu / wall : 0.0, usage_end.ru_maxrss);
+
+    return WIFEXITED(status) ? WEXITSTATUS(status) : EXIT_FAILURE;
+}
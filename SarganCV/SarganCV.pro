@@ -4,3 +4,6 @@ SUBDIRS += \
     SarganDEMO \
     SarganStreamer \
     SarganYOLO
+
+# Нагрузочный тест стримера (POSIX)
+unix: SUBDIRS += SarganBench
@@ -62,7 +62,6 @@ int main()
         // Адрес сервера по которому доступен поток
         // http://localhost:8080/bgr
 
-        std::vector<uchar> buff_bgr;
         i++;
         if (!USE_WEBCAM)
             frame = cv::imread( "C:\\TEMP\\test-image.bmp" );
@@ -75,18 +74,24 @@ int main()
                     CV_RGB(0, 0, 0), // font color
                     2);
 
-        cv::imencode(".jpg", frame, buff_bgr, params);
         // Выгрузка изображения в поток
-        streamer.publish("/bgr", std::string(buff_bgr.begin(), buff_bgr.end()));
+        // Кадр кодируется только при наличии зрителей
+        streamer.publish("/bgr", [&]() {
+            std::vector<uchar> buff_bgr;
+            cv::imencode(".jpg", frame, buff_bgr, params);
+            return std::string(buff_bgr.begin(), buff_bgr.end());
+        });
 
-        // Формат HSV
-        cv::Mat hsv;
-        cv::cvtColor(frame, hsv, cv::COLOR_BGR2HSV);
         // Адрес сервера с потоком в формате HSV
         // http://localhost:8080/hsv
-        std::vector<uchar> buff_hsv;
-        cv::imencode(".jpg", hsv, buff_hsv, params);
-        streamer.publish("/hsv", std::string(buff_hsv.begin(), buff_hsv.end()));
+        streamer.publish("/hsv", [&]() {
+            // Формат HSV
+            cv::Mat hsv;
+            cv::cvtColor(frame, hsv, cv::COLOR_BGR2HSV);
+            std::vector<uchar> buff_hsv;
+            cv::imencode(".jpg", hsv, buff_hsv, params);
+            return std::string(buff_hsv.begin(), buff_hsv.end());
+        });
 
         // Задержка 100 мс
         std::this_thread::sleep_for(std::chrono::milliseconds(100));
@@ -2,6 +2,7 @@
 
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 
 // Reference https://developer.mozilla.org/en-US/docs/Web/HTTP/Messages#http_responses
@@ -25,7 +26,7 @@ class HTTPResponse {
         return stream.str();
     }
 
-    void setVersion(const std::string& version) { version_ = version; }
+    void setVersion(std::string_view version) { version_ = std::string(version); }
     void setStatusCode(const int& status_code) { status_code_ = status_code; }
     void setStatusText(const std::string& status_text) { status_text_ = status_text; }
     void setValue(const std::string& key, const std::string& value) { headers_[key] = value; }
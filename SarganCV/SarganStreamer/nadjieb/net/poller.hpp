@@ -0,0 +1,215 @@
+#pragma once
+
+#include <nadjieb/net/socket.hpp>
+#include <nadjieb/utils/non_copyable.hpp>
+
+#if defined NADJIEB_MJPEG_STREAMER_PLATFORM_LINUX && !defined NADJIEB_MJPEG_STREAMER_NO_EPOLL
+#define NADJIEB_MJPEG_STREAMER_EPOLL
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+#include <cerrno>
+#include <cstdint>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+namespace nadjieb {
+namespace net {
+
+enum PollInterest { POLLER_READ = 1, POLLER_WRITE = 2 };
+
+struct PollEvent {
+    SocketFD fd;
+    bool readable;
+    bool writable;
+    bool error;
+};
+
+// Readiness notification for a set of sockets. On Linux it is an edge-triggered
+// epoll instance with O(1) add/remove and an eventfd for wakeup(), so callers must
+// drain a socket until EWOULDBLOCK after each event. Elsewhere it falls back to
+// poll() over a compact pollfd array with swap-remove; there wakeup() is not
+// available and callers should wait with a timeout.
+class Poller : public nadjieb::utils::NonCopyable {
+   public:
+    Poller() {
+#ifdef NADJIEB_MJPEG_STREAMER_EPOLL
+        epoll_fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+        panicIfUnexpected(epoll_fd_ < 0, "epoll_create1() failed");
+
+        wakeup_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        panicIfUnexpected(wakeup_fd_ < 0, "eventfd() failed");
+
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.fd = wakeup_fd_;
+        auto res = ::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wakeup_fd_, &ev);
+        panicIfUnexpected(res < 0, "epoll_ctl() failed");
+#endif
+    }
+
+    virtual ~Poller() {
+#ifdef NADJIEB_MJPEG_STREAMER_EPOLL
+        ::close(wakeup_fd_);
+        ::close(epoll_fd_);
+#endif
+    }
+
+    static bool canWakeup() {
+#ifdef NADJIEB_MJPEG_STREAMER_EPOLL
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    void add(SocketFD fd, int interest) {
+#ifdef NADJIEB_MJPEG_STREAMER_EPOLL
+        control(EPOLL_CTL_ADD, fd, interest);
+#else
+        auto it = index_by_fd_.find(fd);
+        if (it != index_by_fd_.end()) {
+            fds_[it->second].events = toPollEvents(interest);
+            return;
+        }
+
+        index_by_fd_[fd] = fds_.size();
+        fds_.emplace_back(NADJIEB_MJPEG_STREAMER_POLLFD{fd, toPollEvents(interest), 0});
+#endif
+    }
+
+    void modify(SocketFD fd, int interest) {
+#ifdef NADJIEB_MJPEG_STREAMER_EPOLL
+        control(EPOLL_CTL_MOD, fd, interest);
+#else
+        auto it = index_by_fd_.find(fd);
+        if (it != index_by_fd_.end()) {
+            fds_[it->second].events = toPollEvents(interest);
+        }
+#endif
+    }
+
+    void remove(SocketFD fd) {
+#ifdef NADJIEB_MJPEG_STREAMER_EPOLL
+        ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+#else
+        auto it = index_by_fd_.find(fd);
+        if (it == index_by_fd_.end()) {
+            return;
+        }
+
+        auto index = it->second;
+        index_by_fd_.erase(it);
+        if (index != fds_.size() - 1) {
+            fds_[index] = fds_.back();
+            index_by_fd_[fds_[index].fd] = index;
+        }
+        fds_.pop_back();
+#endif
+    }
+
+    // Interrupts a blocking wait() from another thread.
+    void wakeup() {
+#ifdef NADJIEB_MJPEG_STREAMER_EPOLL
+        uint64_t one = 1;
+        auto res = ::write(wakeup_fd_, &one, sizeof(one));
+        (void)res;
+#endif
+    }
+
+    // Returns the number of events or NADJIEB_MJPEG_STREAMER_SOCKET_ERROR.
+    int wait(std::vector<PollEvent>& events, int timeout) {
+        events.clear();
+#ifdef NADJIEB_MJPEG_STREAMER_EPOLL
+        int count = ::epoll_wait(epoll_fd_, ready_, MAX_EVENTS, timeout);
+        if (count < 0) {
+            return (errno == EINTR) ? 0 : NADJIEB_MJPEG_STREAMER_SOCKET_ERROR;
+        }
+
+        for (int i = 0; i < count; ++i) {
+            if (ready_[i].data.fd == wakeup_fd_) {
+                uint64_t value;
+                auto res = ::read(wakeup_fd_, &value, sizeof(value));
+                (void)res;
+                continue;
+            }
+
+            auto flags = ready_[i].events;
+            events.push_back(PollEvent{
+                ready_[i].data.fd, (flags & EPOLLIN) != 0, (flags & EPOLLOUT) != 0,
+                (flags & (EPOLLERR | EPOLLHUP)) != 0});
+        }
+#else
+        if (fds_.empty()) {
+            return 0;
+        }
+
+        int count = pollSockets(&fds_[0], fds_.size(), timeout);
+        if (count == NADJIEB_MJPEG_STREAMER_SOCKET_ERROR) {
+            return NADJIEB_MJPEG_STREAMER_SOCKET_ERROR;
+        }
+
+        for (size_t i = 0; i < fds_.size() && (int)events.size() < count; ++i) {
+            auto flags = fds_[i].revents;
+            if (flags == 0) {
+                continue;
+            }
+
+            events.push_back(PollEvent{
+                fds_[i].fd, (flags & (POLLRDNORM | POLLIN)) != 0, (flags & (POLLWRNORM | POLLOUT)) != 0,
+                (flags & (POLLERR | POLLHUP | POLLNVAL)) != 0});
+        }
+#endif
+        return (int)events.size();
+    }
+
+   private:
+#ifdef NADJIEB_MJPEG_STREAMER_EPOLL
+    static const int MAX_EVENTS = 256;
+
+    int epoll_fd_ = -1;
+    int wakeup_fd_ = -1;
+    struct epoll_event ready_[MAX_EVENTS];
+
+    void control(int op, SocketFD fd, int interest) {
+        struct epoll_event ev = {};
+        ev.events = EPOLLET | EPOLLRDHUP;
+        if (interest & POLLER_READ) {
+            ev.events |= EPOLLIN;
+        }
+        if (interest & POLLER_WRITE) {
+            ev.events |= EPOLLOUT;
+        }
+        ev.data.fd = fd;
+
+        auto res = ::epoll_ctl(epoll_fd_, op, fd, &ev);
+        if (res < 0 && op == EPOLL_CTL_ADD && errno == EEXIST) {
+            res = ::epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &ev);
+        }
+
+        // Another thread closed the socket meanwhile: there is nothing to watch.
+        if (res < 0 && (errno == EBADF || errno == ENOENT)) {
+            return;
+        }
+        panicIfUnexpected(res < 0, "epoll_ctl() failed");
+    }
+#else
+    std::vector<NADJIEB_MJPEG_STREAMER_POLLFD> fds_;
+    std::unordered_map<SocketFD, size_t> index_by_fd_;
+
+    static short toPollEvents(int interest) {
+        short events = 0;
+        if (interest & POLLER_READ) {
+            events |= POLLRDNORM;
+        }
+        if (interest & POLLER_WRITE) {
+            events |= POLLWRNORM;
+        }
+        return events;
+    }
+#endif
+};
+}  // namespace net
+}  // namespace nadjieb
@@ -13,23 +13,45 @@
 #elif defined NADJIEB_MJPEG_STREAMER_PLATFORM_LINUX
 #include <arpa/inet.h>
 #include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <poll.h>
 #include <signal.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #elif defined NADJIEB_MJPEG_STREAMER_PLATFORM_DARWIN
 #include <arpa/inet.h>
 #include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <poll.h>
 #include <signal.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #else
 #error "Unsupported OS, please commit an issue."
 #endif
 
+// MSG_ZEROCOPY transmission (Linux 4.14+). Completions arrive on the socket error
+// queue, which level-triggered poll() would report over and over, so it needs the
+// epoll backend. Define NADJIEB_MJPEG_STREAMER_NO_ZEROCOPY to leave it out.
+#if defined NADJIEB_MJPEG_STREAMER_PLATFORM_LINUX && defined SO_ZEROCOPY && defined MSG_ZEROCOPY \
+    && !defined NADJIEB_MJPEG_STREAMER_NO_ZEROCOPY && !defined NADJIEB_MJPEG_STREAMER_NO_EPOLL
+#define NADJIEB_MJPEG_STREAMER_ZEROCOPY
+#include <linux/errqueue.h>
+#endif
+
+// Several listening sockets on one port, connections balanced by the kernel
+// (Linux 3.9+; elsewhere SO_REUSEPORT does not balance).
+#if defined NADJIEB_MJPEG_STREAMER_PLATFORM_LINUX && defined SO_REUSEPORT
+#define NADJIEB_MJPEG_STREAMER_REUSEPORT
+#endif
+
+#include <cstdint>
 #include <stdexcept>
 #include <string>
 
@@ -105,6 +127,26 @@ static void setSocketReuseAddress(SocketFD sockfd) {
     panicIfUnexpected(res == NADJIEB_MJPEG_STREAMER_SOCKET_ERROR, "setSocketReuseAddress() failed", sockfd);
 }
 
+#ifdef NADJIEB_MJPEG_STREAMER_REUSEPORT
+static void setSocketReusePort(SocketFD sockfd) {
+    const int enable = 1;
+    auto res = ::setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, (const char*)&enable, sizeof(int));
+
+    panicIfUnexpected(res == NADJIEB_MJPEG_STREAMER_SOCKET_ERROR, "setSocketReusePort() failed", sockfd);
+}
+#endif
+
+// Frames are written in full as soon as possible, do not wait to coalesce segments.
+static void setSocketNoDelay(SocketFD sockfd) {
+    const int enable = 1;
+    ::setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, (const char*)&enable, sizeof(int));
+}
+
+// A fixed send buffer disables the kernel autotuning for the socket.
+static void setSocketSendBuffer(SocketFD sockfd, int size) {
+    ::setsockopt(sockfd, SOL_SOCKET, SO_SNDBUF, (const char*)&size, sizeof(int));
+}
+
 static void setSocketNonblock(SocketFD sockfd) {
     unsigned long ul = true;
     int res;
@@ -133,8 +175,23 @@ static void listenOnSocket(SocketFD sockfd, int backlog) {
     panicIfUnexpected(res == NADJIEB_MJPEG_STREAMER_SOCKET_ERROR, "listenOnSocket() failed", sockfd);
 }
 
-static SocketFD acceptNewSocket(SocketFD sockfd) {
-    return ::accept(sockfd, nullptr, nullptr);
+// Accepts a connection and returns the address of the peer as text.
+static SocketFD acceptNewSocket(SocketFD sockfd, std::string& peer) {
+    struct sockaddr_storage addr;
+    socklen_t addr_len = sizeof(addr);
+    auto new_socket = ::accept(sockfd, (struct sockaddr*)&addr, &addr_len);
+
+    char text[INET6_ADDRSTRLEN] = {0};
+    if (new_socket != NADJIEB_MJPEG_STREAMER_INVALID_SOCKET) {
+        if (addr.ss_family == AF_INET) {
+            inet_ntop(AF_INET, &((struct sockaddr_in*)&addr)->sin_addr, text, sizeof(text));
+        } else if (addr.ss_family == AF_INET6) {
+            inet_ntop(AF_INET6, &((struct sockaddr_in6*)&addr)->sin6_addr, text, sizeof(text));
+        }
+    }
+    peer = text;
+
+    return new_socket;
 }
 
 static int readFromSocket(SocketFD socket, char* buffer, size_t length, int flags) {
@@ -153,7 +210,117 @@ static int sendViaSocket(SocketFD socket, const char* buffer, size_t length, int
 #endif
 }
 
-static int pollSockets(NADJIEB_MJPEG_STREAMER_POLLFD* fds, size_t nfds, long timeout) {
+// Sends FIN once the response is out; the peer then closes the connection.
+static void shutdownSocketWrite(SocketFD sockfd) {
+#ifdef NADJIEB_MJPEG_STREAMER_PLATFORM_WINDOWS
+    ::shutdown(sockfd, SD_SEND);
+#else
+    ::shutdown(sockfd, SHUT_WR);
+#endif
+}
+
+struct SocketBuffer {
+    const char* data;
+    size_t size;
+};
+
+// Scatter-gather send: all buffers go out in one call without joining them first.
+static int sendBuffersViaSocket(SocketFD socket, const SocketBuffer* buffers, size_t count, int flags) {
+    const size_t max_count = 8;
+    count = (count < max_count) ? count : max_count;
+#ifdef NADJIEB_MJPEG_STREAMER_PLATFORM_WINDOWS
+    WSABUF wsa_buffers[max_count];
+    for (size_t i = 0; i < count; ++i) {
+        wsa_buffers[i].buf = const_cast<char*>(buffers[i].data);
+        wsa_buffers[i].len = (ULONG)buffers[i].size;
+    }
+
+    DWORD sent = 0;
+    auto res = WSASend(socket, wsa_buffers, (DWORD)count, &sent, (DWORD)flags, nullptr, nullptr);
+    return (res == SOCKET_ERROR) ? SOCKET_ERROR : (int)sent;
+#else
+    struct iovec iov[max_count];
+    for (size_t i = 0; i < count; ++i) {
+        iov[i].iov_base = const_cast<char*>(buffers[i].data);
+        iov[i].iov_len = buffers[i].size;
+    }
+
+    struct msghdr msg = {};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
+    return (int)::sendmsg(socket, &msg, flags);
+#endif
+}
+
+#ifdef NADJIEB_MJPEG_STREAMER_ZEROCOPY
+static bool setSocketZeroCopy(SocketFD sockfd) {
+    const int enable = 1;
+    return ::setsockopt(sockfd, SOL_SOCKET, SO_ZEROCOPY, &enable, sizeof(int)) == 0;
+}
+
+// A second descriptor of the socket; the connection stays open until both are closed.
+static SocketFD duplicateSocket(SocketFD sockfd) {
+    return ::dup(sockfd);
+}
+
+// Closes the connection with a reset, which drops the data still queued for sending.
+static void resetSocket(SocketFD sockfd) {
+    struct linger abort = {1, 0};
+    ::setsockopt(sockfd, SOL_SOCKET, SO_LINGER, &abort, sizeof(abort));
+    ::close(sockfd);
+}
+
+// Reads one message of the error queue. Returns false once the queue is empty;
+// `completion` tells whether the message reported finished zero-copy sends
+// [first, last] and `copied` whether the kernel fell back to copying them.
+static bool readZeroCopyCompletion(SocketFD sockfd, bool& completion, uint32_t& first, uint32_t& last, bool& copied) {
+    char control[128];
+    struct msghdr msg = {};
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    completion = false;
+    if (::recvmsg(sockfd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1) {
+        return false;
+    }
+
+    for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR)
+            && !(cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)) {
+            continue;
+        }
+
+        const auto* err = reinterpret_cast<const struct sock_extended_err*>(CMSG_DATA(cmsg));
+        if (err->ee_errno != 0 || err->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+            continue;
+        }
+
+        completion = true;
+        first = err->ee_info;
+        last = err->ee_data;
+        copied = (err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) != 0;
+    }
+
+    return true;
+}
+#endif
+
+// Pending zero-copy completions make the poller report an error on a healthy
+// socket; they are read by the worker sending to it.
+static bool hasZeroCopyCompletions(SocketFD sockfd) {
+#ifdef NADJIEB_MJPEG_STREAMER_ZEROCOPY
+    char control[128];
+    struct msghdr msg = {};
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    return ::recvmsg(sockfd, &msg, MSG_ERRQUEUE | MSG_PEEK | MSG_DONTWAIT) != -1;
+#else
+    (void)sockfd;
+    return false;
+#endif
+}
+
+[[maybe_unused]] static int pollSockets(NADJIEB_MJPEG_STREAMER_POLLFD* fds, size_t nfds, long timeout) {
 #ifdef NADJIEB_MJPEG_STREAMER_PLATFORM_WINDOWS
     return WSAPoll(&fds[0], (ULONG)nfds, timeout);
 #elif defined NADJIEB_MJPEG_STREAMER_PLATFORM_LINUX || defined NADJIEB_MJPEG_STREAMER_PLATFORM_DARWIN
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <nadjieb/net/client.hpp>
+#include <nadjieb/net/socket.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace nadjieb {
+namespace net {
+// Counters of one subscriber. Dropped frames were replaced while waiting for
+// a slow connection; skipped ones were left out for the client's ?fps= limit.
+struct ClientStats {
+    SocketFD sockfd{};
+    Transport transport = Transport::MULTIPART;
+    // Variant key ("scale=0.5&q=60"), empty for the original frames.
+    std::string variant;
+    double max_fps = 0.0;
+    uint64_t frames_sent = 0;
+    uint64_t frames_dropped = 0;
+    uint64_t frames_skipped = 0;
+    uint64_t bytes_sent = 0;
+    size_t queue_depth = 0;
+    double connected_seconds = 0.0;
+};
+
+struct TopicStats {
+    std::string path;
+    bool event_stream = false;
+    std::string media_type;
+    uint64_t frames_published = 0;
+    std::vector<ClientStats> clients;
+};
+
+inline const char* transportName(Transport transport) {
+    switch (transport) {
+        case Transport::WEBSOCKET:
+            return "websocket";
+        case Transport::EVENT_STREAM:
+            return "event-stream";
+        case Transport::MEDIA:
+            return "media";
+        default:
+            return "multipart";
+    }
+}
+}  // namespace net
+}  // namespace nadjieb
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+namespace nadjieb {
+namespace net {
+// Encoding variant of a topic requested by a client, e.g. "/sargan?scale=0.5&q=60".
+// Values are rounded to coarse steps so that clients asking for nearly the same
+// variant share one encoded frame and the number of variants stays small.
+struct Variant {
+    // Resize factor in (0, 1], 1 keeps the original resolution.
+    double scale = 1.0;
+    // JPEG quality in [1, 100], 0 leaves it to the producer.
+    int quality = 0;
+
+    bool isDefault() const { return (scale >= 1.0 && quality == 0); }
+
+    // Canonical name of the variant, empty for the default one.
+    std::string key() const {
+        if (isDefault()) {
+            return std::string();
+        }
+
+        std::ostringstream oss;
+        oss << "scale=" << scale << "&q=" << quality;
+        return oss.str();
+    }
+
+    static Variant fromQuery(std::string_view query) {
+        Variant variant;
+
+        forEachQueryParam(query, [&](std::string_view name, const std::string& value) {
+            if (name == "scale") {
+                auto scale = std::strtod(value.c_str(), nullptr);
+                if (scale > 0.0 && scale < 1.0) {
+                    // 5% steps, at least 5%.
+                    variant.scale = std::max(std::round(scale * 20.0), 1.0) / 20.0;
+                }
+            } else if (name == "q") {
+                auto quality = std::atoi(value.c_str());
+                if (quality > 0 && quality <= 100) {
+                    // Steps of 5, at least 5.
+                    variant.quality = std::max((quality + 2) / 5 * 5, 5);
+                }
+            }
+        });
+
+        return variant;
+    }
+
+    // Calls fn(name, value) for every "name=value" parameter of the query.
+    template <typename Fn>
+    static void forEachQueryParam(std::string_view query, Fn&& fn) {
+        while (!query.empty()) {
+            auto param = query.substr(0, query.find('&'));
+            query.remove_prefix(std::min(param.size() + 1, query.size()));
+
+            auto pos = param.find('=');
+            if (pos == std::string_view::npos) {
+                continue;
+            }
+
+            fn(param.substr(0, pos), std::string(param.substr(pos + 1)));
+        }
+    }
+};
+
+// Frame rate limit requested by a client, e.g. "/sargan?fps=2"; 0 means every
+// frame. It is not part of the variant: clients with different rates share the
+// encoded frames and only skip some of them.
+inline double maxFpsFromQuery(std::string_view query) {
+    double max_fps = 0.0;
+    Variant::forEachQueryParam(query, [&](std::string_view name, const std::string& value) {
+        if (name == "fps") {
+            auto fps = std::strtod(value.c_str(), nullptr);
+            if (fps > 0.0 && fps <= 1000.0) {
+                max_fps = fps;
+            }
+        }
+    });
+    return max_fps;
+}
+}  // namespace net
+}  // namespace nadjieb
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <nadjieb/utils/platform.hpp>
+
+#ifdef NADJIEB_MJPEG_STREAMER_PLATFORM_WINDOWS
+#include <windows.h>
+#elif defined NADJIEB_MJPEG_STREAMER_PLATFORM_LINUX
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace nadjieb {
+namespace utils {
+// Lowers the priority of the calling thread by `niceness` (1..19), so streaming
+// threads yield the CPU to the application. Linux applies it per thread, Windows
+// maps any positive value to below normal; other platforms ignore it.
+inline void lowerThreadPriority(int niceness) {
+    if (niceness <= 0) {
+        return;
+    }
+#ifdef NADJIEB_MJPEG_STREAMER_PLATFORM_WINDOWS
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+#elif defined NADJIEB_MJPEG_STREAMER_PLATFORM_LINUX
+    ::setpriority(PRIO_PROCESS, (id_t)::syscall(SYS_gettid), niceness);
+#endif
+}
+}  // namespace utils
+}  // namespace nadjieb
@@ -7,7 +7,14 @@ QT += core network
 
 SOURCES += \
         main.cpp \
+        asyncdetector.cpp \
+        fastnms.cpp \
+        h264encoder.cpp \
+        jpegencoder.cpp \
+        layerprofiler.cpp \
+        mp4muxer.cpp \
         neuralnetdetector.cpp \
+        resolutioncontroller.cpp \
         udppacket.cpp
 
 
@@ -26,6 +33,25 @@ unix {
     LIBS += -L/usr/local/lib -lopencv_core -lopencv_highgui -lopencv_imgcodecs -lopencv_videoio -lopencv_imgproc -lopencv_dnn -pthread
 }
 
+# JPEG через libjpeg-turbo: qmake CONFIG+=turbojpeg
+turbojpeg {
+    DEFINES += SARGAN_USE_TURBOJPEG
+    LIBS += -lturbojpeg
+}
+
+# Поток H.264 через libx264: qmake CONFIG+=x264
+x264 {
+    DEFINES += SARGAN_USE_X264
+    LIBS += -lx264
+}
+
 HEADERS += \
+    asyncdetector.h \
+    fastnms.h \
+    h264encoder.h \
+    jpegencoder.h \
+    layerprofiler.h \
+    mp4muxer.h \
     neuralnetdetector.h \
+    resolutioncontroller.h \
     udppacket.h
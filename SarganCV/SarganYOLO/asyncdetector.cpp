@@ -0,0 +1,116 @@
+#include "asyncdetector.h"
+
+AsyncDetector::AsyncDetector(const std::string model, const std::string classes, int width, int height, int instances)
+{
+    // Every instance owns its network, cv::dnn::Net is not thread safe.
+    for (int i = 0; i < std::max(instances, 1); i++)
+    {
+        std::unique_ptr<Slot> slot(new Slot());
+        slot->detector.reset(new NeuralNetDetector(model, classes, width, height));
+        slots.push_back(std::move(slot));
+    }
+
+    for (auto &slot : slots)
+        slot->worker = std::thread(&AsyncDetector::worker, this, slot.get());
+}
+
+AsyncDetector::~AsyncDetector()
+{
+    // A worker finishes the frame it was given before it stops.
+    stopping = true;
+    for (auto &slot : slots)
+    {
+        {
+            std::unique_lock<std::mutex> lock(slot->mtx);
+            slot->condition.notify_all();
+        }
+        if (slot->worker.joinable())
+            slot->worker.join();
+    }
+}
+
+void AsyncDetector::set_tiling(bool enabled, int size, float overlap)
+{
+    for (auto &slot : slots)
+        slot->detector->set_tiling(enabled, size, overlap);
+}
+
+int AsyncDetector::set_input_sizes(const std::vector<int> &sizes)
+{
+    int levels = 0;
+    for (auto &slot : slots)
+        levels = slot->detector->set_input_sizes(sizes);
+    return levels;
+}
+
+void AsyncDetector::set_profiler(LayerProfiler *profiler)
+{
+    for (auto &slot : slots)
+        slot->detector->set_profiler(profiler);
+}
+
+std::future<DetectionResult> AsyncDetector::submit(const cv::Mat &frame)
+{
+    Slot *slot = slots[next_slot].get();
+    next_slot = (next_slot + 1) % slots.size();
+
+    std::unique_lock<std::mutex> lock(slot->mtx);
+    slot->condition.wait(lock, [&]() { return !slot->busy; });
+
+    // The capture buffer is reused by the camera while other frames are in
+    // flight, so keep our own copy then. A single instance is waited for
+    // before the next capture and shares the buffer.
+    if (slots.size() > 1)
+        frame.copyTo(slot->frame);
+    else
+        slot->frame = frame;
+    slot->promise = std::promise<DetectionResult>();
+    std::future<DetectionResult> result = slot->promise.get_future();
+    slot->busy = true;
+    slot->condition.notify_all();
+
+    return result;
+}
+
+void AsyncDetector::worker(Slot *slot)
+{
+    while (true)
+    {
+        std::unique_lock<std::mutex> lock(slot->mtx);
+        slot->condition.wait(lock, [&]() { return slot->busy || stopping; });
+        if (!slot->busy)
+            break;
+        lock.unlock();
+
+        try
+        {
+            int level = input_level;
+            if (level >= 0)
+                slot->detector->set_input_level(level);
+            slot->detector->set_all_detections(all_detections);
+
+            DetectionResult result;
+            result.img = slot->detector->process(slot->frame);
+            result.class_ids = slot->detector->get_class_ids();
+            result.confidences = slot->detector->get_confidences();
+            result.boxes = slot->detector->get_boxes();
+            result.classes = slot->detector->get_classes();
+            result.all_class_ids = slot->detector->get_all_class_ids();
+            result.all_confidences = slot->detector->get_all_confidences();
+            result.all_boxes = slot->detector->get_all_boxes();
+            result.all_classes = slot->detector->get_all_classes();
+            result.inference_time = slot->detector->get_inference();
+            result.tiles = slot->detector->get_tiles();
+            result.input_size = slot->detector->get_input_size();
+            slot->promise.set_value(std::move(result));
+        }
+        catch (...)
+        {
+            slot->promise.set_exception(std::current_exception());
+        }
+
+        lock.lock();
+        slot->busy = false;
+        slot->condition.notify_all();
+    }
+}
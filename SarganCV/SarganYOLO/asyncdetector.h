@@ -0,0 +1,79 @@
+#ifndef ASYNCDETECTOR_H
+#define ASYNCDETECTOR_H
+
+#include "neuralnetdetector.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/** Результат обработки одного кадра */
+struct DetectionResult
+{
+    cv::Mat img;
+    std::vector<int> class_ids;
+    std::vector<float> confidences;
+    std::vector<cv::Rect> boxes;
+    std::vector<std::string> classes;
+    /** Все детекции после NMS (если запрошены set_all_detections) */
+    std::vector<int> all_class_ids;
+    std::vector<float> all_confidences;
+    std::vector<cv::Rect> all_boxes;
+    std::vector<std::string> all_classes;
+    float inference_time = 0;
+    int tiles = 1;
+    cv::Size input_size;
+};
+
+/** Асинхронный детектор с несколькими экземплярами сети
+ *   Кадры распределяются по экземплярам по кругу, каждый экземпляр
+ *   обрабатывается своим потоком, поэтому подготовка и прогон кадра N+1
+ *   идут параллельно с кадром N. Одновременно в работе не больше одного
+ *   кадра на экземпляр: submit() ждет освобождения очередного экземпляра.
+ *   Результаты приходят в порядке отправки, если future забираются по очереди.
+ */
+class AsyncDetector
+{
+private:
+    /** Экземпляр сети со своим потоком */
+    struct Slot
+    {
+        std::unique_ptr<NeuralNetDetector> detector;
+        std::thread worker;
+        std::mutex mtx;
+        std::condition_variable condition;
+        bool busy = false;
+        cv::Mat frame;
+        std::promise<DetectionResult> promise;
+    };
+
+    std::vector<std::unique_ptr<Slot>> slots;
+    size_t next_slot = 0;
+    /** Входное разрешение для следующих кадров (-1 - не менять) */
+    std::atomic<int> input_level{-1};
+    /** Нужны ли все детекции для следующих кадров */
+    std::atomic<bool> all_detections{false};
+    std::atomic<bool> stopping{false};
+
+    void worker(Slot *slot);
+public:
+    AsyncDetector(const std::string model, const std::string classes, int width, int height, int instances);
+    ~AsyncDetector();
+    /** Настройки применяются ко всем экземплярам (до первого submit) */
+    void set_tiling(bool enabled, int size, float overlap);
+    int set_input_sizes(const std::vector<int> &sizes);
+    void set_profiler(LayerProfiler *profiler);
+    std::vector<cv::Size> get_input_sizes(void) { return slots[0]->detector->get_input_sizes(); }
+    /** Входное разрешение для следующих кадров */
+    void set_input_level(int level) { input_level = level; }
+    /** Все детекции после NMS для следующих кадров (например, есть зрители метаданных) */
+    void set_all_detections(bool enabled) { all_detections = enabled; }
+    int get_instances(void) { return (int)slots.size(); }
+    /** Отправить кадр в обработку (кадр копируется, если экземпляров несколько) */
+    std::future<DetectionResult> submit(const cv::Mat &frame);
+};
+
+#endif // ASYNCDETECTOR_H
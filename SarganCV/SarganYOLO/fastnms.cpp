@@ -0,0 +1,179 @@
+#include "fastnms.h"
+
+#include <opencv2/core/hal/intrin.hpp>
+
+#include <algorithm>
+
+/** Состояния кандидатов */
+static const signed char NMS_UNKNOWN    = 0;
+static const signed char NMS_KEPT       = 1;
+static const signed char NMS_SUPPRESSED = 2;
+
+FastNMS::FastNMS(float score_threshold, float iou_threshold, int top_k, bool class_aware)
+{
+    this->score_threshold = score_threshold;
+    this->iou_threshold = iou_threshold;
+    this->top_k = top_k;
+    this->class_aware = class_aware;
+}
+
+int FastNMS::prepare(const std::vector<cv::Rect> &boxes, const std::vector<float> &scores, const std::vector<int> &class_ids)
+{
+    // Drop weak candidates (same rule as cv::dnn::NMSBoxes).
+    // Boxes may stick out of the frame, so both coordinate bounds are tracked.
+    order.clear();
+    int min_coord = 0;
+    int max_coord = 0;
+    for (size_t i = 0; i < scores.size(); ++i)
+    {
+        if (scores[i] > score_threshold)
+        {
+            order.push_back((int)i);
+            min_coord = std::min(min_coord, std::min(boxes[i].x, boxes[i].y));
+            max_coord = std::max(max_coord, std::max(boxes[i].br().x, boxes[i].br().y));
+        }
+    }
+
+    // Sort by confidence and cap the candidate count to bound the worst case.
+    auto by_score = [&](int a, int b) { return scores[a] > scores[b] || (scores[a] == scores[b] && a < b); };
+    if ((int)order.size() > top_k)
+    {
+        std::partial_sort(order.begin(), order.begin() + top_k, order.end(), by_score);
+        order.resize(top_k);
+    }
+    else
+    {
+        std::sort(order.begin(), order.end(), by_score);
+    }
+
+    const int n = (int)order.size();
+    x1.resize(n);
+    y1.resize(n);
+    x2.resize(n);
+    y2.resize(n);
+    area.resize(n);
+    iou.resize(n);
+    state.assign(n, NMS_UNKNOWN);
+
+    // Class-aware (batched) suppression: every class is shifted into its own
+    // coordinate range, so boxes of different classes never overlap.
+    const float class_offset = (float)(max_coord - min_coord + 1);
+    for (int k = 0; k < n; ++k)
+    {
+        const cv::Rect &box = boxes[order[k]];
+        float offset = class_aware ? class_ids[order[k]] * class_offset : 0.0f;
+        x1[k] = box.x + offset;
+        y1[k] = box.y + offset;
+        x2[k] = box.x + box.width + offset;
+        y2[k] = box.y + box.height + offset;
+        area[k] = (float)box.width * (float)box.height;
+    }
+
+    return n;
+}
+
+void FastNMS::iou_row(int i, int from, int to)
+{
+    int j = from;
+#if CV_SIMD128
+    const cv::v_float32x4 v_x1 = cv::v_setall_f32(x1[i]);
+    const cv::v_float32x4 v_y1 = cv::v_setall_f32(y1[i]);
+    const cv::v_float32x4 v_x2 = cv::v_setall_f32(x2[i]);
+    const cv::v_float32x4 v_y2 = cv::v_setall_f32(y2[i]);
+    const cv::v_float32x4 v_area = cv::v_setall_f32(area[i]);
+    const cv::v_float32x4 v_zero = cv::v_setzero_f32();
+    const cv::v_float32x4 v_eps = cv::v_setall_f32(1e-6f);
+    for (; j + 4 <= to; j += 4)
+    {
+        cv::v_float32x4 w = cv::v_max(cv::v_min(v_x2, cv::v_load(&x2[j])) - cv::v_max(v_x1, cv::v_load(&x1[j])), v_zero);
+        cv::v_float32x4 h = cv::v_max(cv::v_min(v_y2, cv::v_load(&y2[j])) - cv::v_max(v_y1, cv::v_load(&y1[j])), v_zero);
+        cv::v_float32x4 inter = w * h;
+        cv::v_float32x4 uni = v_area + cv::v_load(&area[j]) - inter;
+        cv::v_store(&iou[j], inter / cv::v_max(uni, v_eps));
+    }
+#endif
+    // Scalar tail.
+    for (; j < to; ++j)
+    {
+        float w = std::max(std::min(x2[i], x2[j]) - std::max(x1[i], x1[j]), 0.0f);
+        float h = std::max(std::min(y2[i], y2[j]) - std::max(y1[i], y1[j]), 0.0f);
+        float inter = w * h;
+        iou[j] = inter / std::max(area[i] + area[j] - inter, 1e-6f);
+    }
+}
+
+bool FastNMS::survives(int i)
+{
+    if (state[i] != NMS_UNKNOWN)
+        return state[i] == NMS_KEPT;
+
+    // Candidate i is kept by greedy NMS if none of the higher scored boxes
+    // that overlap it were kept themselves.
+    const size_t base = overlaps.size();
+    iou_row(i, 0, i);
+    for (int j = 0; j < i; ++j)
+    {
+        if (iou[j] > iou_threshold)
+            overlaps.push_back(j);
+    }
+
+    bool kept = true;
+    for (size_t k = base; k < overlaps.size() && kept; ++k)
+    {
+        if (survives(overlaps[k]))
+            kept = false;
+    }
+    overlaps.resize(base);
+
+    state[i] = kept ? NMS_KEPT : NMS_SUPPRESSED;
+    return kept;
+}
+
+void FastNMS::suppress(const std::vector<cv::Rect> &boxes, const std::vector<float> &scores,
+                       const std::vector<int> &class_ids, std::vector<int> &indices)
+{
+    indices.clear();
+    const int n = prepare(boxes, scores, class_ids);
+
+    for (int i = 0; i < n; ++i)
+    {
+        if (state[i] == NMS_SUPPRESSED)
+            continue;
+
+        state[i] = NMS_KEPT;
+        indices.push_back(order[i]);
+
+        iou_row(i, i + 1, n);
+        for (int j = i + 1; j < n; ++j)
+        {
+            if (iou[j] > iou_threshold)
+                state[j] = NMS_SUPPRESSED;
+        }
+    }
+}
+
+int FastNMS::largest(const std::vector<cv::Rect> &boxes, const std::vector<float> &scores,
+                     const std::vector<int> &class_ids)
+{
+    const int n = prepare(boxes, scores, class_ids);
+    if (n == 0)
+        return -1;
+    // Nothing to suppress.
+    if (n == 1)
+        return order[0];
+
+    // Walk candidates from the largest area down; the first survivor wins.
+    // Ties go to the higher score, as in the full NMS path.
+    by_area.resize(n);
+    for (int k = 0; k < n; ++k)
+        by_area[k] = k;
+    std::stable_sort(by_area.begin(), by_area.end(), [&](int a, int b) { return area[a] > area[b]; });
+
+    for (int k : by_area)
+    {
+        if (survives(k))
+            return order[k];
+    }
+
+    return -1;
+}
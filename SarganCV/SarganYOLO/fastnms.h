@@ -0,0 +1,52 @@
+#ifndef FASTNMS_H
+#define FASTNMS_H
+
+#include <opencv2/opencv.hpp>
+
+#include <vector>
+
+/** Подавление немаксимумов (Non Maximum Suppression) с ограничением top-K
+ *   Кандидаты ниже порога отсекаются, оставшиеся сортируются по уверенности
+ *   и обрезаются до top_k штук, поэтому худшее время обработки ограничено
+ *   O(top_k^2) независимо от количества ложных срабатываний в кадре.
+ *   IoU считается векторно (SIMD) по массивам координат.
+ */
+class FastNMS
+{
+private:
+    /** Порог уверенности и порог перекрытия */
+    float score_threshold;
+    float iou_threshold;
+    /** Максимальное число кандидатов, попадающих в NMS */
+    int top_k;
+    /** Подавлять боксы только внутри одного класса */
+    bool class_aware;
+
+    /** Буферы кандидатов (переиспользуются между кадрами) */
+    std::vector<int> order;
+    std::vector<float> x1, y1, x2, y2, area;
+    std::vector<float> iou;
+    std::vector<signed char> state;
+    std::vector<int> by_area;
+    std::vector<int> overlaps;
+
+    /** Отбор и сортировка кандидатов */
+    int prepare(const std::vector<cv::Rect> &boxes, const std::vector<float> &scores, const std::vector<int> &class_ids);
+    /** IoU бокса i с боксами [from, to) */
+    void iou_row(int i, int from, int to);
+    /** Выжил ли кандидат i при жадном NMS (ленивое вычисление) */
+    bool survives(int i);
+public:
+    FastNMS(float score_threshold, float iou_threshold, int top_k, bool class_aware);
+    /** Полный NMS: индексы выживших боксов по убыванию уверенности */
+    void suppress(const std::vector<cv::Rect> &boxes, const std::vector<float> &scores,
+                  const std::vector<int> &class_ids, std::vector<int> &indices);
+    /** Быстрый путь: индекс выжившего бокса с наибольшей площадью или -1
+     *   Результат совпадает с полным NMS, но вычисляется только та часть
+     *   решений, которая нужна для проверки самых крупных кандидатов.
+     */
+    int largest(const std::vector<cv::Rect> &boxes, const std::vector<float> &scores,
+                const std::vector<int> &class_ids);
+};
+
+#endif // FASTNMS_H
@@ -0,0 +1,160 @@
+#include "h264encoder.h"
+
+#include <algorithm>
+
+H264Encoder::H264Encoder(int bitrate, int keyint, int fps)
+{
+    this->bitrate = std::max(bitrate, 1);
+    this->keyint = std::max(keyint, 1);
+    this->fps = std::max(fps, 1);
+}
+
+H264Encoder::~H264Encoder()
+{
+    close();
+}
+
+bool H264Encoder::is_available()
+{
+#ifdef SARGAN_USE_X264
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool H264Encoder::open(int width, int height)
+{
+    close();
+
+    // 4:2:0 needs even dimensions.
+    if (width <= 0 || height <= 0 || width % 2 || height % 2)
+        return false;
+
+#ifdef SARGAN_USE_X264
+    x264_param_t param;
+    if (x264_param_default_preset(&param, "veryfast", "zerolatency") < 0)
+        return false;
+
+    param.i_width = width;
+    param.i_height = height;
+    param.i_csp = X264_CSP_I420;
+    param.i_fps_num = fps;
+    param.i_fps_den = 1;
+    param.i_keyint_max = keyint;
+    // One thread: the stream must not take the CPU from the detector.
+    param.i_threads = 1;
+    param.rc.i_rc_method = X264_RC_ABR;
+    param.rc.i_bitrate = bitrate;
+    param.rc.i_vbv_max_bitrate = bitrate;
+    param.rc.i_vbv_buffer_size = bitrate;
+    // SPS and PPS go to the MP4 header once; NAL units get length prefixes.
+    param.b_repeat_headers = 0;
+    param.b_annexb = 0;
+
+    if (x264_param_apply_profile(&param, "main") < 0)
+        return false;
+
+    encoder = x264_encoder_open(&param);
+    if (!encoder)
+        return false;
+
+    x264_nal_t *nals;
+    int count;
+    if (x264_encoder_headers(encoder, &nals, &count) < 0)
+    {
+        close();
+        return false;
+    }
+
+    for (int i = 0; i < count; ++i)
+    {
+        // Skip the 4-byte length prefix.
+        std::string nal((const char *)nals[i].p_payload + 4, nals[i].i_payload - 4);
+        if (nals[i].i_type == NAL_SPS)
+            sps = nal;
+        else if (nals[i].i_type == NAL_PPS)
+            pps = nal;
+    }
+
+    if (sps.empty() || pps.empty())
+    {
+        close();
+        return false;
+    }
+
+    this->width = width;
+    this->height = height;
+    pts = 0;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void H264Encoder::close()
+{
+#ifdef SARGAN_USE_X264
+    if (encoder)
+        x264_encoder_close(encoder);
+    encoder = nullptr;
+#endif
+    width = 0;
+    height = 0;
+    sps.clear();
+    pps.clear();
+    data = nullptr;
+    size = 0;
+}
+
+bool H264Encoder::is_open()
+{
+#ifdef SARGAN_USE_X264
+    return encoder != nullptr;
+#else
+    return false;
+#endif
+}
+
+bool H264Encoder::encode(const cv::Mat &img, bool force_key_frame)
+{
+    data = nullptr;
+    size = 0;
+    key_frame = false;
+#ifdef SARGAN_USE_X264
+    if (!encoder || img.cols != width || img.rows != height || img.type() != CV_8UC3)
+        return false;
+
+    cv::cvtColor(img, yuv, cv::COLOR_BGR2YUV_I420);
+
+    x264_picture_t picture;
+    x264_picture_init(&picture);
+    picture.img.i_csp = X264_CSP_I420;
+    picture.img.i_plane = 3;
+    picture.img.plane[0] = yuv.data;
+    picture.img.plane[1] = yuv.data + width * height;
+    picture.img.plane[2] = yuv.data + width * height * 5 / 4;
+    picture.img.i_stride[0] = width;
+    picture.img.i_stride[1] = width / 2;
+    picture.img.i_stride[2] = width / 2;
+    picture.i_pts = pts++;
+    picture.i_type = force_key_frame ? X264_TYPE_IDR : X264_TYPE_AUTO;
+
+    x264_picture_t output;
+    x264_nal_t *nals;
+    int count;
+    int frame_size = x264_encoder_encode(encoder, &nals, &count, &picture, &output);
+    if (frame_size <= 0)
+        return false;
+
+    // The NAL units of a frame are contiguous in memory.
+    data = nals[0].p_payload;
+    size = (size_t)frame_size;
+    key_frame = output.b_keyframe != 0;
+    return true;
+#else
+    (void)img;
+    (void)force_key_frame;
+    return false;
+#endif
+}
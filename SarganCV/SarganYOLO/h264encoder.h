@@ -0,0 +1,73 @@
+#ifndef H264ENCODER_H
+#define H264ENCODER_H
+
+#include <opencv2/opencv.hpp>
+
+#include <cstdint>
+#include <string>
+
+#ifdef SARGAN_USE_X264
+#include <x264.h>
+#endif
+
+/** Кодировщик H.264 для стримера
+ *   Программный кодировщик libx264 (сборка с SARGAN_USE_X264) в режиме
+ *   минимальной задержки: без B-кадров и упреждающего анализа, битрейт
+ *   ограничен буфером VBV в одну секунду. Кадры выдаются в формате AVC
+ *   (NAL-блоки с 4-байтной длиной), SPS и PPS - отдельно, для MP4.
+ *   Без libx264 кодировщик не открывается.
+ */
+class H264Encoder
+{
+private:
+    /** Битрейт, кбит/с; интервал ключевых кадров, кадров; частота кадров */
+    int bitrate;
+    int keyint;
+    int fps;
+
+#ifdef SARGAN_USE_X264
+    x264_t *encoder = nullptr;
+#endif
+    int width = 0;
+    int height = 0;
+    int64_t pts = 0;
+
+    /** Кадр в I420 */
+    cv::Mat yuv;
+
+    std::string sps;
+    std::string pps;
+
+    /** Результат последнего кодирования */
+    const uchar *data = nullptr;
+    size_t size = 0;
+    bool key_frame = false;
+public:
+    H264Encoder(int bitrate = 1000, int keyint = 60, int fps = 30);
+    ~H264Encoder();
+    H264Encoder(const H264Encoder &) = delete;
+    H264Encoder &operator=(const H264Encoder &) = delete;
+
+    /** Собрано ли приложение с libx264 */
+    static bool is_available(void);
+
+    /** Запуск кодировщика для кадров заданного размера (четного) */
+    bool open(int width, int height);
+    void close(void);
+    bool is_open(void);
+
+    /** Кодирование кадра (CV_8UC3 BGR того же размера)
+     *   @param force_key_frame - сделать кадр ключевым (IDR)
+     *   @return false, если кадр не закодирован
+     *   Результат действителен до следующего вызова encode().
+     */
+    bool encode(const cv::Mat &img, bool force_key_frame = false);
+    const uchar *get_data(void) { return data; }
+    size_t get_size(void) { return size; }
+    bool is_key_frame(void) { return key_frame; }
+
+    const std::string &get_sps(void) { return sps; }
+    const std::string &get_pps(void) { return pps; }
+};
+
+#endif // H264ENCODER_H
@@ -0,0 +1,250 @@
+#include "jpegencoder.h"
+
+#include <algorithm>
+#include <atomic>
+
+/** Маркеры JPEG */
+static const uchar JPEG_MARKER = 0xFF;
+static const uchar JPEG_SOF0   = 0xC0;
+static const uchar JPEG_SOF15  = 0xCF;
+static const uchar JPEG_DHT    = 0xC4;
+static const uchar JPEG_JPG    = 0xC8;
+static const uchar JPEG_DAC    = 0xCC;
+static const uchar JPEG_RST0   = 0xD0;
+static const uchar JPEG_EOI    = 0xD9;
+static const uchar JPEG_SOS    = 0xDA;
+static const uchar JPEG_DRI    = 0xDD;
+
+// Finds the frame header (SOF) and the scan header (SOS) of a baseline JPEG.
+static bool find_headers(const uchar *data, size_t size, size_t &sof, size_t &sos)
+{
+    sof = 0;
+    size_t pos = 2;
+    while (pos + 4 <= size)
+    {
+        if (data[pos] != JPEG_MARKER)
+            return false;
+
+        const uchar marker = data[pos + 1];
+        // Fill bytes before a marker.
+        if (marker == JPEG_MARKER)
+        {
+            ++pos;
+            continue;
+        }
+
+        if (marker == JPEG_SOS)
+        {
+            sos = pos;
+            return sof != 0;
+        }
+        if (marker >= JPEG_SOF0 && marker <= JPEG_SOF15 && marker != JPEG_DHT && marker != JPEG_JPG && marker != JPEG_DAC)
+            sof = pos;
+
+        pos += 2 + ((data[pos + 2] << 8) | data[pos + 3]);
+    }
+
+    return false;
+}
+
+// Entropy coded data of the single scan: from the end of the SOS header to EOI.
+static bool find_scan(const uchar *data, size_t size, size_t &begin, size_t &end)
+{
+    size_t sof, sos;
+    if (!find_headers(data, size, sof, sos))
+        return false;
+
+    begin = sos + 2 + ((data[sos + 2] << 8) | data[sos + 3]);
+    end = size - 2;
+    return begin <= end && data[end] == JPEG_MARKER && data[end + 1] == JPEG_EOI;
+}
+
+JpegEncoder::JpegEncoder(int quality, int subsampling, int stripes)
+{
+    set_quality(quality);
+    set_subsampling(subsampling);
+    set_stripes(stripes);
+}
+
+JpegEncoder::~JpegEncoder()
+{
+#ifdef SARGAN_USE_TURBOJPEG
+    for (Part &part : parts)
+    {
+        if (part.handle)
+            tjDestroy(part.handle);
+        if (part.encoded)
+            tjFree(part.encoded);
+    }
+#endif
+}
+
+void JpegEncoder::set_quality(int quality)
+{
+    this->quality = std::min(std::max(quality, 1), 100);
+}
+
+void JpegEncoder::set_subsampling(int subsampling)
+{
+    this->subsampling = std::min(std::max(subsampling, JPEG_SUBSAMPLING_444), JPEG_SUBSAMPLING_420);
+}
+
+void JpegEncoder::set_stripes(int stripes)
+{
+    this->stripes = std::max(stripes, 1);
+}
+
+bool JpegEncoder::encode_part(const cv::Mat &img, Part &part)
+{
+    const bool gray = img.channels() == 1;
+#ifdef SARGAN_USE_TURBOJPEG
+    static const int TJ_SUBSAMPLING[] = {TJSAMP_444, TJSAMP_422, TJSAMP_420};
+    const int tj_subsampling = gray ? TJSAMP_GRAY : TJ_SUBSAMPLING[subsampling];
+
+    if (!part.handle)
+        part.handle = tjInitCompress();
+    if (!part.handle)
+        return false;
+
+    // Grow the output buffer to the worst case once, then keep it.
+    unsigned long bound = tjBufSize(img.cols, img.rows, tj_subsampling);
+    if (part.capacity < bound)
+    {
+        if (part.encoded)
+            tjFree(part.encoded);
+        part.encoded = tjAlloc((int)bound);
+        part.capacity = part.encoded ? bound : 0;
+        if (!part.encoded)
+            return false;
+    }
+
+    unsigned long size = part.capacity;
+    if (tjCompress2(part.handle, img.data, img.cols, (int)img.step, img.rows, gray ? TJPF_GRAY : TJPF_BGR,
+                    &part.encoded, &size, tj_subsampling, quality, TJFLAG_NOREALLOC) != 0)
+        return false;
+
+    part.data = part.encoded;
+    part.size = size;
+#else
+    static const int CV_SUBSAMPLING[] = {cv::IMWRITE_JPEG_SAMPLING_FACTOR_444,
+                                         cv::IMWRITE_JPEG_SAMPLING_FACTOR_422,
+                                         cv::IMWRITE_JPEG_SAMPLING_FACTOR_420};
+    std::vector<int> params = {cv::IMWRITE_JPEG_QUALITY, quality};
+    if (!gray)
+    {
+        params.push_back(cv::IMWRITE_JPEG_SAMPLING_FACTOR);
+        params.push_back(CV_SUBSAMPLING[subsampling]);
+    }
+
+    if (!cv::imencode(".jpg", img, part.encoded, params))
+        return false;
+
+    part.data = part.encoded.data();
+    part.size = part.encoded.size();
+#endif
+    return true;
+}
+
+bool JpegEncoder::encode(const cv::Mat &img)
+{
+    data = nullptr;
+    size = 0;
+    if (img.empty())
+        return false;
+
+    // MCU size: stripes must be cut on MCU row boundaries.
+    const bool gray = img.channels() == 1;
+    const int mcu_width = (gray || subsampling == JPEG_SUBSAMPLING_444) ? 8 : 16;
+    const int mcu_height = (gray || subsampling != JPEG_SUBSAMPLING_420) ? 8 : 16;
+
+    int count = 1;
+    int stripe_rows = img.rows;
+    if (stripes > 1 && img.rows >= JPEG_STRIPE_MIN_ROWS)
+    {
+        stripe_rows = (img.rows + stripes - 1) / stripes;
+        stripe_rows = (stripe_rows + mcu_height - 1) / mcu_height * mcu_height;
+        count = (img.rows + stripe_rows - 1) / stripe_rows;
+    }
+
+    // One restart interval per stripe; DRI holds 16 bits.
+    const int restart_interval = (img.cols + mcu_width - 1) / mcu_width * (stripe_rows / mcu_height);
+    if (restart_interval > 0xFFFF)
+        count = 1;
+
+    if ((int)parts.size() < count)
+        parts.resize(count);
+
+    if (count == 1)
+    {
+        if (!encode_part(img, parts[0]))
+            return false;
+        data = parts[0].data;
+        size = parts[0].size;
+        return true;
+    }
+
+    std::atomic<bool> failed(false);
+    cv::parallel_for_(cv::Range(0, count), [&](const cv::Range &range)
+    {
+        for (int i = range.start; i < range.end; ++i)
+        {
+            int top = i * stripe_rows;
+            cv::Mat stripe = img(cv::Rect(0, top, img.cols, std::min(stripe_rows, img.rows - top)));
+            if (!encode_part(stripe, parts[i]))
+                failed = true;
+        }
+    });
+
+    if (failed)
+        return false;
+
+    return stitch(count, img.rows, restart_interval);
+}
+
+bool JpegEncoder::stitch(int count, int rows, int restart_interval)
+{
+    // Every stripe is a complete JPEG with the same (standard) tables, so the
+    // scans can be joined: headers of the first stripe with the full height and
+    // a restart interval equal to one stripe, then the entropy coded data of the
+    // stripes separated by RSTn markers. The decoder resets the DC predictors at
+    // each marker exactly as every stripe encoder started from zero.
+    const Part &first = parts[0];
+    size_t sof, sos;
+    if (!find_headers(first.data, first.size, sof, sos))
+        return false;
+
+    buffer.clear();
+    buffer.insert(buffer.end(), first.data, first.data + sos);
+    buffer[sof + 5] = (uchar)(rows >> 8);
+    buffer[sof + 6] = (uchar)(rows & 0xFF);
+
+    const uchar dri[] = {JPEG_MARKER, JPEG_DRI, 0x00, 0x04, (uchar)(restart_interval >> 8), (uchar)(restart_interval & 0xFF)};
+    buffer.insert(buffer.end(), dri, dri + sizeof(dri));
+
+    for (int i = 0; i < count; ++i)
+    {
+        const Part &part = parts[i];
+        size_t begin, end;
+        if (!find_scan(part.data, part.size, begin, end))
+            return false;
+
+        if (i == 0)
+        {
+            // Keep the SOS header of the first stripe.
+            begin = sos;
+        }
+        else
+        {
+            buffer.push_back(JPEG_MARKER);
+            buffer.push_back((uchar)(JPEG_RST0 + ((i - 1) & 7)));
+        }
+        buffer.insert(buffer.end(), part.data + begin, part.data + end);
+    }
+
+    buffer.push_back(JPEG_MARKER);
+    buffer.push_back(JPEG_EOI);
+
+    data = buffer.data();
+    size = buffer.size();
+    return true;
+}
@@ -0,0 +1,82 @@
+#ifndef JPEGENCODER_H
+#define JPEGENCODER_H
+
+#include <opencv2/opencv.hpp>
+
+#include <vector>
+
+#ifdef SARGAN_USE_TURBOJPEG
+#include <turbojpeg.h>
+#endif
+
+/** Субдискретизация цветности */
+static const int JPEG_SUBSAMPLING_444 = 0;
+static const int JPEG_SUBSAMPLING_422 = 1;
+static const int JPEG_SUBSAMPLING_420 = 2;
+
+/** Кадры ниже этой высоты кодируются целиком, без полос */
+static const int JPEG_STRIPE_MIN_ROWS = 480;
+
+/** Кодировщик JPEG для стримера
+ *   Контекст кодировщика и выходной буфер переиспользуются между кадрами:
+ *   при сборке с SARGAN_USE_TURBOJPEG используется libjpeg-turbo (tjCompress2),
+ *   иначе cv::imencode. Большие кадры кодируются параллельно горизонтальными
+ *   полосами, которые склеиваются в один JPEG маркерами перезапуска (RSTn).
+ */
+class JpegEncoder
+{
+private:
+    /** Закодированная полоса кадра */
+    struct Part
+    {
+#ifdef SARGAN_USE_TURBOJPEG
+        tjhandle handle = nullptr;
+        unsigned char *encoded = nullptr;
+        unsigned long capacity = 0;
+#else
+        std::vector<uchar> encoded;
+#endif
+        const uchar *data = nullptr;
+        size_t size = 0;
+    };
+
+    /** Качество 1..100 и субдискретизация */
+    int quality;
+    int subsampling;
+    /** Число полос (1 - без распараллеливания) */
+    int stripes;
+
+    /** Полосы (буферы и компрессоры переиспользуются между кадрами) */
+    std::vector<Part> parts;
+    /** Склеенный кадр */
+    std::vector<uchar> buffer;
+    /** Результат последнего кодирования */
+    const uchar *data = nullptr;
+    size_t size = 0;
+
+    /** Кодирование изображения в отдельный JPEG */
+    bool encode_part(const cv::Mat &img, Part &part);
+    /** Склейка полос в buffer */
+    bool stitch(int count, int rows, int restart_interval);
+public:
+    JpegEncoder(int quality = 90, int subsampling = JPEG_SUBSAMPLING_420, int stripes = 1);
+    ~JpegEncoder();
+    JpegEncoder(const JpegEncoder &) = delete;
+    JpegEncoder &operator=(const JpegEncoder &) = delete;
+
+    void set_quality(int quality);
+    void set_subsampling(int subsampling);
+    void set_stripes(int stripes);
+    int get_quality(void) { return quality; }
+    int get_subsampling(void) { return subsampling; }
+    int get_stripes(void) { return stripes; }
+
+    /** Кодирование кадра (CV_8UC3 BGR или CV_8UC1)
+     *   Результат действителен до следующего вызова encode().
+     */
+    bool encode(const cv::Mat &img);
+    const uchar *get_data(void) { return data; }
+    size_t get_size(void) { return size; }
+};
+
+#endif // JPEGENCODER_H
@@ -0,0 +1,126 @@
+#include "layerprofiler.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+LayerProfiler::LayerProfiler(int window)
+{
+    this->window = (size_t)std::max(window, 0);
+}
+
+void LayerProfiler::add(cv::dnn::Net &net, const std::vector<double> &layers_ticks, const cv::Size &input)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+
+    Profile &profile = profiles[std::make_pair(input.width, input.height)];
+    std::vector<Layer> &layers = profile.layers;
+
+    // Layer timings follow the order of getLayerNames().
+    if (layers.size() != layers_ticks.size())
+    {
+        std::vector<std::string> names = net.getLayerNames();
+        layers.clear();
+        layers.resize(layers_ticks.size());
+        for (size_t i = 0; i < layers.size(); i++)
+        {
+            if (i < names.size())
+            {
+                layers[i].name = names[i];
+                layers[i].type = net.getLayer(names[i])->type;
+            }
+            else
+            {
+                layers[i].name = "layer_" + std::to_string(i);
+            }
+            layers[i].samples.assign(window, 0.0f);
+        }
+        profile.count = 0;
+        profile.next = 0;
+    }
+
+    double ms_per_tick = 1000.0 / cv::getTickFrequency();
+    profile.total_runs++;
+
+    // Without a window every run is kept.
+    if (window == 0)
+    {
+        for (size_t i = 0; i < layers.size(); i++)
+            layers[i].samples.push_back((float)(layers_ticks[i] * ms_per_tick));
+        profile.count++;
+        return;
+    }
+
+    for (size_t i = 0; i < layers.size(); i++)
+        layers[i].samples[profile.next] = (float)(layers_ticks[i] * ms_per_tick);
+
+    profile.next = (profile.next + 1) % window;
+    profile.count = std::min(profile.count + 1, window);
+}
+
+void LayerProfiler::report(std::ostream &oss, const Profile &profile)
+{
+    struct Row
+    {
+        const Layer *layer;
+        double mean;
+        double p99;
+    };
+
+    const size_t count = profile.count;
+    std::vector<Row> rows;
+    std::vector<float> sorted;
+    double total = 0;
+    for (const Layer &layer : profile.layers)
+    {
+        sorted.assign(layer.samples.begin(), layer.samples.begin() + count);
+        double sum = 0;
+        for (float ms : sorted)
+            sum += ms;
+
+        double p99 = 0;
+        if (!sorted.empty())
+        {
+            size_t k = std::min(sorted.size() - 1, (size_t)(0.99 * sorted.size()));
+            std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+            p99 = sorted[k];
+        }
+
+        double mean = count > 0 ? sum / count : 0;
+        total += mean;
+        rows.push_back({&layer, mean, p99});
+    }
+
+    std::sort(rows.begin(), rows.end(), [](const Row &a, const Row &b) { return a.mean > b.mean; });
+
+    oss << "Runs: " << profile.total_runs << " (window " << count << ")\n";
+    oss << "Total mean, ms: " << total << "\n\n";
+    oss << std::left << std::setw(40) << "Layer" << std::setw(20) << "Type"
+        << std::right << std::setw(12) << "Mean, ms" << std::setw(12) << "P99, ms" << std::setw(10) << "Share, %" << "\n";
+    for (const Row &row : rows)
+    {
+        oss << std::left << std::setw(40) << row.layer->name << std::setw(20) << row.layer->type
+            << std::right << std::setw(12) << row.mean << std::setw(12) << row.p99
+            << std::setw(10) << std::setprecision(2) << (total > 0 ? 100.0 * row.mean / total : 0)
+            << std::setprecision(3) << "\n";
+    }
+}
+
+std::string LayerProfiler::report(void)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(3);
+    if (profiles.empty())
+        oss << "Runs: 0\n";
+
+    // A table per network input size.
+    for (const auto &entry : profiles)
+    {
+        oss << "Input: " << entry.first.first << "x" << entry.first.second << "\n";
+        report(oss, entry.second);
+        oss << "\n";
+    }
+    return oss.str();
+}
@@ -0,0 +1,61 @@
+#ifndef LAYERPROFILER_H
+#define LAYERPROFILER_H
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/dnn.hpp>
+
+#include <map>
+#include <ostream>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+/** Размер окна профилировщика по умолчанию (прогонов сети, 0 - все прогоны) */
+static const int PROFILE_WINDOW = 300;
+
+/** Профилировщик слоев нейросети
+ *   Накапливает время каждого слоя по данным getPerfProfile за последние
+ *   window прогонов и строит таблицу, отсортированную по среднему времени:
+ *   имя слоя, тип, среднее и p99 время, доля от общего времени сети.
+ *   Прогоны с разным входным разрешением сети учитываются раздельно.
+ *   Потокобезопасен: данные добавляют потоки детектора, отчет читает стример.
+ */
+class LayerProfiler
+{
+private:
+    /** Статистика слоя */
+    struct Layer
+    {
+        std::string name;
+        std::string type;
+        std::vector<float> samples;
+    };
+
+    /** Профиль одного входного разрешения */
+    struct Profile
+    {
+        std::vector<Layer> layers;
+        /** Число и позиция записанных прогонов в окне */
+        size_t count = 0;
+        size_t next = 0;
+        /** Общее число учтенных прогонов */
+        size_t total_runs = 0;
+    };
+
+    std::mutex mtx;
+    /** Профили по входному разрешению (ширина, высота) */
+    std::map<std::pair<int, int>, Profile> profiles;
+    size_t window;
+
+    /** Таблица одного профиля */
+    void report(std::ostream &oss, const Profile &profile);
+public:
+    LayerProfiler(int window = PROFILE_WINDOW);
+    /** Учесть прогон сети (тики getPerfProfile по слоям) с входом input */
+    void add(cv::dnn::Net &net, const std::vector<double> &layers_ticks, const cv::Size &input);
+    /** Текстовые таблицы профиля по входным разрешениям */
+    std::string report(void);
+};
+
+#endif // LAYERPROFILER_H
@@ -6,6 +6,8 @@
 #include <filesystem>
 #include <chrono>
 #include <cmath>
+#include <deque>
+#include <algorithm>
 
 #include <opencv2/opencv.hpp>
 #include <opencv2/core.hpp>
@@ -14,8 +16,16 @@
 
 #include "nadjieb/streamer.hpp"
 using MJPEGStreamer = nadjieb::MJPEGStreamer;
+using StreamVariant = nadjieb::net::Variant;
+using StreamFrameInfo = nadjieb::net::FrameInfo;
+using StreamTimestamp = nadjieb::net::Timestamp;
+using StreamTransport = nadjieb::net::Transport;
 
-#include "neuralnetdetector.h"
+#include "asyncdetector.h"
+#include "resolutioncontroller.h"
+#include "jpegencoder.h"
+#include "h264encoder.h"
+#include "mp4muxer.h"
 
 #include <QSettings>
 #include <QUdpSocket>
@@ -35,6 +45,40 @@ static short VIDEO_FILES_COUNT = 10;  // Максимальное кол-во в
 
 static std::string NN_DIR = "nn";     // Папка в которой лежит сеть
 
+// Режим патрулирования: кадр обрабатывается тайлами с перекрытием
+static bool TILED_MODE = false;       // Включить тайловый режим
+static int TILE_SIZE = 640;           // Размер тайла в пикселях кадра
+static float TILE_OVERLAP = 0.2f;     // Доля перекрытия соседних тайлов
+
+// Адаптивное входное разрешение сети
+static std::vector<int> ADAPTIVE_SIZES; // Набор разрешений, например 320,480,640
+static double FRAME_BUDGET_MS = 0;      // Бюджет времени кадра, мс (0 - отключено)
+
+// Асинхронный инференс: два экземпляра сети обрабатывают соседние кадры
+static bool ASYNC_INFERENCE = false;
+
+// Режим профилирования: число обработанных кадров (не прогонов сети: при
+// разбиении на тайлы их несколько на кадр), после которого таблица слоев
+// сохраняется в profile.txt и программа завершается (0 - отключено)
+static int PROFILE_FRAMES = 0;
+
+// Кодирование JPEG для стримера
+static int JPEG_QUALITY = 90;                        // Качество по умолчанию
+static int JPEG_SUBSAMPLING = JPEG_SUBSAMPLING_420;  // 0 - 4:4:4, 1 - 4:2:2, 2 - 4:2:0
+static int JPEG_STRIPES = 1;                         // Число параллельных полос
+
+// Поток H.264 (сборка с libx264)
+static int H264_BITRATE = 1000;       // Битрейт, кбит/с
+static int H264_KEYINT = 60;          // Интервал ключевых кадров, кадров
+
+// Ограничения стримера: инференс не должен уступать процессор зрителям
+static int STREAM_WORKERS = 2;         // Потоки отправки кадров
+static int STREAM_LISTENERS = 1;       // Потоки приема соединений (SO_REUSEPORT)
+static int STREAM_NICENESS = 10;       // Понижение приоритета потоков стримера
+static int STREAM_MAX_CLIENTS = 32;    // Всего соединений (0 - без ограничения)
+static int STREAM_MAX_PER_IP = 4;      // Соединений с одного адреса
+static int STREAM_MAX_PER_TOPIC = 16;  // Зрителей одного потока
+
 // Для отладки
 static std::string NN_ONNX = "debug.onnx";    // Файл модели
 static std::string NN_NAMES = "debug.names";  // Файл названий классов
@@ -110,6 +154,75 @@ std::string getVideoFileName()
     return oss.str();
 }
 
+/** Описание кадра в JSON для клиентов стримера (WebSocket, /sargan/meta)
+ *   Время захвата кадра в мс от эпохи позволяет клиенту оценить задержку,
+ *   боксы заданы в пикселях кадра: [x, y, w, h].
+ *   @param frame_id - номер обработанного кадра
+ *   @param capture_time - время захвата кадра
+ *   @param result - результат детектора: все детекции после NMS
+ *                   (или только цель, если они не были запрошены)
+ *   @param target - бокс выбранной цели (nullptr, если цели нет)
+ *   @param command - команда управления (пустая, если цели нет)
+ *   @return {"frame":..., "time":..., "width":..., "height":..., "inference":...,
+ *            "target":{"index":..., "x":..., "y":...}, "cmd":..., "angle":...,
+ *            "detections":[{"class":..., "confidence":..., "box":[...]}]}
+ *   index - номер цели в detections
+ */
+std::string getDetectionsJson(std::uint64_t frame_id, const StreamTimestamp &capture_time,
+                              const DetectionResult &result, int width, int height,
+                              const cv::Rect *target, const std::string &command, int angle)
+{
+    using namespace std::chrono;
+    auto time = duration_cast<milliseconds>(capture_time.wall.time_since_epoch()).count();
+
+    const bool all = !result.all_boxes.empty();
+    const std::vector<int> &class_ids = all ? result.all_class_ids : result.class_ids;
+    const std::vector<float> &confidences = all ? result.all_confidences : result.confidences;
+    const std::vector<cv::Rect> &boxes = all ? result.all_boxes : result.boxes;
+    const std::vector<std::string> &classes = all ? result.all_classes : result.classes;
+
+    std::ostringstream oss;
+    oss << "{\"frame\":" << frame_id << ",\"time\":" << time << ",\"width\":" << width << ",\"height\":" << height
+        << ",\"inference\":" << std::fixed << std::setprecision(4) << result.inference_time;
+    if (target)
+    {
+        auto it = std::find(boxes.begin(), boxes.end(), *target);
+        int index = it != boxes.end() ? (int)(it - boxes.begin()) : -1;
+        cv::Point center = (target->br() + target->tl()) * 0.5;
+        oss << ",\"target\":{\"index\":" << index << ",\"x\":" << center.x << ",\"y\":" << center.y << "}";
+    }
+    else
+        oss << ",\"target\":null";
+    if (command.empty())
+        oss << ",\"cmd\":null";
+    else
+        oss << ",\"cmd\":\"" << command << "\",\"angle\":" << angle;
+
+    oss << ",\"detections\":[" << std::setprecision(3);
+    for (size_t i = 0; i < boxes.size(); ++i)
+    {
+        // Названия классов идут по одному на детекцию, как и идентификаторы
+        const int id = i < class_ids.size() ? class_ids[i] : -1;
+        std::string name = i < classes.size() ? classes[i] : std::to_string(id);
+        // Названия классов берутся из файла, экранируем кавычки
+        std::string escaped;
+        for (char c : name)
+        {
+            if (c == '"' || c == '\\')
+                escaped += '\\';
+            if ((unsigned char)c >= 0x20)
+                escaped += c;
+        }
+
+        if (i > 0)
+            oss << ',';
+        oss << "{\"class\":\"" << escaped << "\",\"confidence\":" << (i < confidences.size() ? confidences[i] : 0.0f)
+            << ",\"box\":[" << boxes[i].x << ',' << boxes[i].y << ',' << boxes[i].width << ',' << boxes[i].height << "]}";
+    }
+    oss << "]}";
+    return oss.str();
+}
+
 int main()
 {
     ///////////////////////////////////////////////////////////////////////////
@@ -131,6 +244,26 @@ int main()
     CAMERA_ANGLE = settings.value("CAMERA_ANGLE").toFloat();
     SIGHT_WIDTH = settings.value("SIGHT_WIDTH").toFloat();
     RULER_H = settings.value("RULER_H").toUInt();
+    TILED_MODE = settings.value("TILED_MODE", TILED_MODE).toBool();
+    TILE_SIZE = settings.value("TILE_SIZE", TILE_SIZE).toInt();
+    TILE_OVERLAP = settings.value("TILE_OVERLAP", TILE_OVERLAP).toFloat();
+    for (const QString &size : settings.value("ADAPTIVE_SIZES").toStringList())
+        if (size.trimmed().toInt() > 0)
+            ADAPTIVE_SIZES.push_back(size.trimmed().toInt());
+    FRAME_BUDGET_MS = settings.value("FRAME_BUDGET_MS", FRAME_BUDGET_MS).toDouble();
+    ASYNC_INFERENCE = settings.value("ASYNC_INFERENCE", ASYNC_INFERENCE).toBool();
+    PROFILE_FRAMES = settings.value("PROFILE_FRAMES", PROFILE_FRAMES).toInt();
+    JPEG_QUALITY = settings.value("JPEG_QUALITY", JPEG_QUALITY).toInt();
+    JPEG_SUBSAMPLING = settings.value("JPEG_SUBSAMPLING", JPEG_SUBSAMPLING).toInt();
+    JPEG_STRIPES = settings.value("JPEG_STRIPES", JPEG_STRIPES).toInt();
+    H264_BITRATE = settings.value("H264_BITRATE", H264_BITRATE).toInt();
+    H264_KEYINT = settings.value("H264_KEYINT", H264_KEYINT).toInt();
+    STREAM_WORKERS = settings.value("STREAM_WORKERS", STREAM_WORKERS).toInt();
+    STREAM_LISTENERS = settings.value("STREAM_LISTENERS", STREAM_LISTENERS).toInt();
+    STREAM_NICENESS = settings.value("STREAM_NICENESS", STREAM_NICENESS).toInt();
+    STREAM_MAX_CLIENTS = settings.value("STREAM_MAX_CLIENTS", STREAM_MAX_CLIENTS).toInt();
+    STREAM_MAX_PER_IP = settings.value("STREAM_MAX_PER_IP", STREAM_MAX_PER_IP).toInt();
+    STREAM_MAX_PER_TOPIC = settings.value("STREAM_MAX_PER_TOPIC", STREAM_MAX_PER_TOPIC).toInt();
 
     UDP_HOST = QHostAddress(settings.value("UDP_HOST").toString());
     UDP_PORT = settings.value("UDP_PORT").toUInt();
@@ -148,6 +281,27 @@ int main()
     std::cout << "CAMERA_ANGLE: " << CAMERA_ANGLE << std::endl;
     std::cout << "SIGHT_WIDTH: " << SIGHT_WIDTH << std::endl;
     std::cout << "RULER_H: " << RULER_H << std::endl;
+    std::cout << "TILED_MODE: " << TILED_MODE << std::endl;
+    std::cout << "TILE_SIZE: " << TILE_SIZE << std::endl;
+    std::cout << "TILE_OVERLAP: " << TILE_OVERLAP << std::endl;
+    std::cout << "ADAPTIVE_SIZES: ";
+    for (int size : ADAPTIVE_SIZES)
+        std::cout << size << " ";
+    std::cout << std::endl;
+    std::cout << "FRAME_BUDGET_MS: " << FRAME_BUDGET_MS << std::endl;
+    std::cout << "ASYNC_INFERENCE: " << ASYNC_INFERENCE << std::endl;
+    std::cout << "PROFILE_FRAMES: " << PROFILE_FRAMES << std::endl;
+    std::cout << "JPEG_QUALITY: " << JPEG_QUALITY << std::endl;
+    std::cout << "JPEG_SUBSAMPLING: " << JPEG_SUBSAMPLING << std::endl;
+    std::cout << "JPEG_STRIPES: " << JPEG_STRIPES << std::endl;
+    std::cout << "H264_BITRATE: " << H264_BITRATE << std::endl;
+    std::cout << "H264_KEYINT: " << H264_KEYINT << std::endl;
+    std::cout << "STREAM_WORKERS: " << STREAM_WORKERS << std::endl;
+    std::cout << "STREAM_LISTENERS: " << STREAM_LISTENERS << std::endl;
+    std::cout << "STREAM_NICENESS: " << STREAM_NICENESS << std::endl;
+    std::cout << "STREAM_MAX_CLIENTS: " << STREAM_MAX_CLIENTS << std::endl;
+    std::cout << "STREAM_MAX_PER_IP: " << STREAM_MAX_PER_IP << std::endl;
+    std::cout << "STREAM_MAX_PER_TOPIC: " << STREAM_MAX_PER_TOPIC << std::endl;
     std::cout << "UDP_HOST: " << UDP_HOST.toString().toStdString() << std::endl;
     std::cout << "UDP_PORT: " << UDP_PORT << std::endl;
 
@@ -170,14 +324,23 @@ int main()
     ///////////////////////////////////////////////////////////////////////////
     // Подготовка стримера
     ///////////////////////////////////////////////////////////////////////////
-    // Задаем качество картинки
-    std::vector<int> params = {cv::IMWRITE_JPEG_QUALITY, 90};
+    // Профилировщик слоев сети (окно на весь прогон в режиме профилирования)
+    LayerProfiler profiler(PROFILE_FRAMES > 0 ? 0 : PROFILE_WINDOW);
+    int profiledFrames = 0;
+
+    // Кодировщик JPEG (контекст и буферы переиспользуются между кадрами)
+    JpegEncoder streamEncoder(JPEG_QUALITY, JPEG_SUBSAMPLING, JPEG_STRIPES);
+
+    // Кодировщик H.264 и упаковщик MP4 (один на всех зрителей потока)
+    H264Encoder h264Encoder(H264_BITRATE, H264_KEYINT, (int)CAMERA_FPS);
+    Mp4Muxer mp4Muxer;
+    std::chrono::steady_clock::time_point h264FrameTime;
     // Создаем объект стримера
     MJPEGStreamer streamer;
-    // Буфер для работы с потоком
-    std::vector<uchar> streamerBuf;
     // Запуск стримера
-    streamer.start(8080);
+    streamer.setConnectionLimits(STREAM_MAX_CLIENTS, STREAM_MAX_PER_IP, STREAM_MAX_PER_TOPIC);
+    streamer.setNiceness(STREAM_NICENESS);
+    streamer.start(8080, STREAM_WORKERS, STREAM_LISTENERS);
     ///////////////////////////////////////////////////////////////////////////
 
     // Получить разрешение камеры по горизонтали и вертикали
@@ -199,12 +362,28 @@ int main()
     if (DIAGNOSTIC_LOG)
         std::cout << model_path.u8string() << std::endl;
 
-    NeuralNetDetector detector(model_path.u8string(), classes_path.u8string(), (int)IMG_WIDTH, (int)IMG_HEIGHT);
+    AsyncDetector detector(model_path.u8string(), classes_path.u8string(), (int)IMG_WIDTH, (int)IMG_HEIGHT,
+                           ASYNC_INFERENCE ? 2 : 1);
+    detector.set_tiling(TILED_MODE, TILE_SIZE, TILE_OVERLAP);
+
+    // Регулятор входного разрешения по бюджету времени кадра
+    if (!ADAPTIVE_SIZES.empty())
+        detector.set_input_sizes(ADAPTIVE_SIZES);
+    ResolutionController resolution(FRAME_BUDGET_MS, detector.get_input_sizes());
+
+    // Профиль слоев сети доступен по адресу http://localhost:8080/profile
+    detector.set_profiler(&profiler);
+    streamer.addEndpoint("/profile", "text/plain; charset=utf-8", [&]() { return profiler.report(); });
+
+    // Счетчики стримера в JSON: http://localhost:8080/stats
+    // (кадры опубликованные, отправленные и потерянные на медленных соединениях,
+    // байты, очередь и время подключения каждого зрителя)
 
     ///////////////////////////////////////////////////////////////////////////
     // Набор глобальных переменных для основного фунционала
     ///////////////////////////////////////////////////////////////////////////
     cv::Mat img;
+    DetectionResult result;
     std::vector<int> class_ids;
     std::vector<float> confidences;
     std::vector<cv::Rect> boxes;
@@ -249,6 +428,9 @@ int main()
     std::string direction;
     int angle;
 
+    // Номер обработанного кадра (для клиентов стримера)
+    std::uint64_t frameId = 0;
+
     // Время работы детектора
     std::stringstream ssTime;
     std::string inference;
@@ -310,6 +492,14 @@ int main()
     std::chrono::time_point<std::chrono::system_clock> videoEndTime;
     bool isRecordStarted = false;
 
+    // Время обработки кадра
+    std::chrono::time_point<std::chrono::steady_clock> frameStartTime;
+    double frameTimeMs;
+
+    // Кадры, отправленные в детектор, и время их захвата
+    std::deque<std::pair<StreamTimestamp, std::future<DetectionResult>>> pending;
+    StreamTimestamp captureTime;
+
     // UDP Packet
     UDPPacket packet;
 
@@ -380,13 +570,24 @@ int main()
         ///////////////////////////////////////////////////////////////////////
         // Отработка детектора
         ///////////////////////////////////////////////////////////////////////
-        img = detector.process(frame);
+        pending.emplace_back(StreamTimestamp::now(), detector.submit(frame));
+
+        // Пока конвейер не заполнен, сразу захватываем следующий кадр
+        if ((int)pending.size() < detector.get_instances())
+            continue;
+
+        captureTime = pending.front().first;
+        frameStartTime = captureTime.monotonic;
+        result = pending.front().second.get();
+        pending.pop_front();
+        ++frameId;
 
         // Результаты работы детектора
-        class_ids = detector.get_class_ids();
-        confidences = detector.get_confidences();
-        boxes = detector.get_boxes();
-        classes = detector.get_classes();
+        img = result.img;
+        class_ids = result.class_ids;
+        confidences = result.confidences;
+        boxes = result.boxes;
+        classes = result.classes;
         ///////////////////////////////////////////////////////////////////////
 
         ///////////////////////////////////////////////////////////////////////
@@ -494,8 +695,13 @@ int main()
 
             // Время работы детектора
             ssTime.str(std::string()); // Очистка строкового стримера
-            ssTime << std::fixed << std::setprecision(2) << detector.get_inference();
+            ssTime << std::fixed << std::setprecision(2) << result.inference_time;
             inference = ssTime.str();
+            // В тайловом режиме время включает все тайлы кадра
+            if (TILED_MODE)
+                inference += " TILES: " + std::to_string(result.tiles);
+            if (!ADAPTIVE_SIZES.empty())
+                inference += " NN: " + std::to_string(result.input_size.width);
 
             // Строка инфорации
             textInfo = " CMD: (" + direction + ":" + std::to_string(angle) + ")" +
@@ -655,18 +861,72 @@ int main()
             //for (auto element : confidences)
             //    std::cout << element << " ";
 
-            //std::cout << std::endl << "inference time: " << detector.get_inference() << std::endl;
+            //std::cout << std::endl << "inference time: " << result.inference_time << std::endl;
             //std::cout << std::endl << detector.get_info();
 
             // Дублируем видео в окне
             cv::imshow("SarganYOLO", img);
         }
 
-        // Отправляем результат в поток
-        cv::imencode(".jpg", img, streamerBuf, params);
-
         // Выгрузка изображения в поток http://localhost:8080/sargan
-        streamer.publish("/sargan", std::string(streamerBuf.begin(), streamerBuf.end()));
+        // Кадр кодируется в JPEG только если поток кто-то смотрит,
+        // уменьшенные варианты: http://localhost:8080/sargan?scale=0.5&q=60
+        // последний кадр одной картинкой: http://localhost:8080/sargan.jpg
+        // По WebSocket (ws://localhost:8080/sargan) за каждым кадром следует
+        // текстовое сообщение с боксами и командой в JSON
+        // Те же данные без видео - события SSE: http://localhost:8080/sargan/meta
+        // Заголовки частей потока: X-Frame-Id (frame в JSON), X-Capture-Timestamp
+        // (захват кадра) и X-Publish-Timestamp (выдача в стример)
+        // Метаданные читают только клиенты WebSocket и SSE, не зрители MJPEG
+        std::string streamMeta;
+        bool metaClients = streamer.hasClient("/sargan", StreamTransport::WEBSOCKET) ||
+                           streamer.hasClient("/sargan/meta");
+        if (metaClients)
+            streamMeta = getDetectionsJson(frameId, captureTime, result, img.cols, img.rows,
+                                           boxes.size() > 0 ? &boxes[bigestIndex] : nullptr,
+                                           boxes.size() > 0 ? direction : std::string(), angle);
+        // Все детекции нужны детектору только при зрителях метаданных
+        detector.set_all_detections(metaClients);
+        if (!streamMeta.empty())
+            streamer.publishEvent("/sargan/meta", streamMeta);
+
+        streamer.publish("/sargan", [&](const StreamVariant &variant) {
+            cv::Mat streamImg = img;
+            if (variant.scale < 1.0)
+                cv::resize(img, streamImg, cv::Size(), variant.scale, variant.scale, cv::INTER_AREA);
+
+            streamEncoder.set_quality(variant.quality > 0 ? variant.quality : JPEG_QUALITY);
+            if (!streamEncoder.encode(streamImg))
+                return std::string();
+            return std::string((const char *)streamEncoder.get_data(), streamEncoder.get_size());
+        }, streamMeta, StreamFrameInfo{frameId, captureTime});
+
+        // H.264 в fragmented MP4: http://localhost:8080/sargan.mp4
+        // Кадр кодируется только если поток кто-то смотрит,
+        // новый зритель получает ключевой кадр сразу
+        if (H264Encoder::is_available())
+        {
+            if (!h264Encoder.is_open() && h264Encoder.open(img.cols, img.rows)
+                && mp4Muxer.set_config(img.cols, img.rows, h264Encoder.get_sps(), h264Encoder.get_pps()))
+                streamer.setMediaInit("/sargan.mp4", "video/mp4", mp4Muxer.get_init());
+
+            if (h264Encoder.is_open() && streamer.hasClient("/sargan.mp4")
+                && h264Encoder.encode(img, streamer.needsKeyFrame("/sargan.mp4")))
+            {
+                // Длительность кадра - фактический интервал между кадрами (не более секунды)
+                auto now = std::chrono::steady_clock::now();
+                double frameSec = h264FrameTime.time_since_epoch().count() == 0
+                                      ? 1.0 / CAMERA_FPS
+                                      : std::chrono::duration<double>(now - h264FrameTime).count();
+                h264FrameTime = now;
+                uint32_t duration = (uint32_t)(std::min(std::max(frameSec, 0.001), 1.0) * MP4_TIMESCALE);
+
+                streamer.publishMedia("/sargan.mp4",
+                                      mp4Muxer.add_frame(h264Encoder.get_data(), h264Encoder.get_size(),
+                                                         h264Encoder.is_key_frame(), duration),
+                                      h264Encoder.is_key_frame());
+            }
+        }
 
         // Сохраняем в видеофайл
 
@@ -674,6 +934,19 @@ int main()
         resize(img, videoImg, cv::Size(), FRAME_SCALE, FRAME_SCALE, cv::INTER_CUBIC);
         video.write(videoImg);
 
+        // Подбор входного разрешения сети для следующего кадра
+        frameTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStartTime).count();
+        detector.set_input_level(resolution.update(frameTimeMs, result.inference_time * 1000.0));
+
+        // Завершение режима профилирования
+        if (PROFILE_FRAMES > 0 && ++profiledFrames >= PROFILE_FRAMES)
+        {
+            std::ofstream profile_file(fs::current_path() / "profile.txt");
+            profile_file << profiler.report();
+            std::cout << profiler.report() << std::endl;
+            break;
+        }
+
         videoEndTime = std::chrono::system_clock::now();
 
         // Новый видео файл каждые 10 секунд
@@ -684,6 +957,13 @@ int main()
         }
     }
 
+    // Дожидаемся кадров, оставшихся в работе у детектора
+    while (!pending.empty())
+    {
+        pending.front().second.wait();
+        pending.pop_front();
+    }
+
     // Остановка стримера
     streamer.stop();
 
@@ -0,0 +1,262 @@
+#include "mp4muxer.h"
+
+// Reference ISO/IEC 14496-12 (ISO BMFF) and ISO/IEC 14496-15 (AVC file format)
+
+static void put_u8(std::string &out, uint8_t value)
+{
+    out.push_back((char)value);
+}
+
+static void put_u16(std::string &out, uint16_t value)
+{
+    out.push_back((char)(value >> 8));
+    out.push_back((char)(value & 0xFF));
+}
+
+static void put_u32(std::string &out, uint32_t value)
+{
+    for (int shift = 24; shift >= 0; shift -= 8)
+        out.push_back((char)((value >> shift) & 0xFF));
+}
+
+static void put_u64(std::string &out, uint64_t value)
+{
+    put_u32(out, (uint32_t)(value >> 32));
+    put_u32(out, (uint32_t)(value & 0xFFFFFFFF));
+}
+
+static void put_zeros(std::string &out, size_t count)
+{
+    out.append(count, '\0');
+}
+
+// Opens a box; the size is patched by end_box().
+static size_t begin_box(std::string &out, const char *type)
+{
+    size_t start = out.size();
+    put_u32(out, 0);
+    out.append(type, 4);
+    return start;
+}
+
+static size_t begin_full_box(std::string &out, const char *type, uint8_t version, uint32_t flags)
+{
+    size_t start = begin_box(out, type);
+    put_u32(out, ((uint32_t)version << 24) | (flags & 0xFFFFFF));
+    return start;
+}
+
+static void end_box(std::string &out, size_t start)
+{
+    uint32_t size = (uint32_t)(out.size() - start);
+    for (int i = 0; i < 4; ++i)
+        out[start + i] = (char)((size >> (24 - 8 * i)) & 0xFF);
+}
+
+// Unity transformation matrix of mvhd and tkhd.
+static void put_matrix(std::string &out)
+{
+    const uint32_t matrix[9] = {0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000};
+    for (uint32_t value : matrix)
+        put_u32(out, value);
+}
+
+bool Mp4Muxer::set_config(int width, int height, const std::string &sps, const std::string &pps)
+{
+    if (sps.size() < 4 || pps.empty())
+        return false;
+
+    sequence = 1;
+    decode_time = 0;
+    init.clear();
+
+    size_t ftyp = begin_box(init, "ftyp");
+    init.append("isom", 4);
+    put_u32(init, 0x200);
+    init.append("isomiso6avc1mp41", 16);
+    end_box(init, ftyp);
+
+    size_t moov = begin_box(init, "moov");
+    {
+        size_t mvhd = begin_full_box(init, "mvhd", 0, 0);
+        put_u32(init, 0);            // creation_time
+        put_u32(init, 0);            // modification_time
+        put_u32(init, 1000);         // timescale
+        put_u32(init, 0);            // duration: unknown, fragmented
+        put_u32(init, 0x00010000);   // rate 1.0
+        put_u16(init, 0x0100);       // volume 1.0
+        put_zeros(init, 10);
+        put_matrix(init);
+        put_zeros(init, 24);         // pre_defined
+        put_u32(init, 2);            // next_track_ID
+        end_box(init, mvhd);
+
+        size_t trak = begin_box(init, "trak");
+        {
+            // Track enabled and in movie.
+            size_t tkhd = begin_full_box(init, "tkhd", 0, 0x000003);
+            put_u32(init, 0);
+            put_u32(init, 0);
+            put_u32(init, 1);        // track_ID
+            put_u32(init, 0);
+            put_u32(init, 0);        // duration
+            put_zeros(init, 8);
+            put_u16(init, 0);        // layer
+            put_u16(init, 0);        // alternate_group
+            put_u16(init, 0);        // volume: video
+            put_u16(init, 0);
+            put_matrix(init);
+            put_u32(init, (uint32_t)width << 16);
+            put_u32(init, (uint32_t)height << 16);
+            end_box(init, tkhd);
+
+            size_t mdia = begin_box(init, "mdia");
+            {
+                size_t mdhd = begin_full_box(init, "mdhd", 0, 0);
+                put_u32(init, 0);
+                put_u32(init, 0);
+                put_u32(init, MP4_TIMESCALE);
+                put_u32(init, 0);
+                put_u16(init, 0x55C4); // language "und"
+                put_u16(init, 0);
+                end_box(init, mdhd);
+
+                size_t hdlr = begin_full_box(init, "hdlr", 0, 0);
+                put_u32(init, 0);
+                init.append("vide", 4);
+                put_zeros(init, 12);
+                init.append("VideoHandler", 13);
+                end_box(init, hdlr);
+
+                size_t minf = begin_box(init, "minf");
+                {
+                    size_t vmhd = begin_full_box(init, "vmhd", 0, 1);
+                    put_zeros(init, 8);     // graphicsmode, opcolor
+                    end_box(init, vmhd);
+
+                    size_t dinf = begin_box(init, "dinf");
+                    size_t dref = begin_full_box(init, "dref", 0, 0);
+                    put_u32(init, 1);
+                    // Media data in the same file.
+                    size_t url = begin_full_box(init, "url ", 0, 1);
+                    end_box(init, url);
+                    end_box(init, dref);
+                    end_box(init, dinf);
+
+                    size_t stbl = begin_box(init, "stbl");
+                    {
+                        size_t stsd = begin_full_box(init, "stsd", 0, 0);
+                        put_u32(init, 1);
+                        size_t avc1 = begin_box(init, "avc1");
+                        put_zeros(init, 6);
+                        put_u16(init, 1);           // data_reference_index
+                        put_zeros(init, 16);
+                        put_u16(init, (uint16_t)width);
+                        put_u16(init, (uint16_t)height);
+                        put_u32(init, 0x00480000);  // 72 dpi
+                        put_u32(init, 0x00480000);
+                        put_u32(init, 0);
+                        put_u16(init, 1);           // frame_count
+                        put_zeros(init, 32);        // compressorname
+                        put_u16(init, 0x0018);      // depth
+                        put_u16(init, 0xFFFF);      // pre_defined -1
+
+                        size_t avcc = begin_box(init, "avcC");
+                        put_u8(init, 1);                   // configurationVersion
+                        put_u8(init, (uint8_t)sps[1]);     // AVCProfileIndication
+                        put_u8(init, (uint8_t)sps[2]);     // profile_compatibility
+                        put_u8(init, (uint8_t)sps[3]);     // AVCLevelIndication
+                        put_u8(init, 0xFF);                // 4-byte NAL lengths
+                        put_u8(init, 0xE1);                // one SPS
+                        put_u16(init, (uint16_t)sps.size());
+                        init.append(sps);
+                        put_u8(init, 1);                   // one PPS
+                        put_u16(init, (uint16_t)pps.size());
+                        init.append(pps);
+                        end_box(init, avcc);
+
+                        end_box(init, avc1);
+                        end_box(init, stsd);
+
+                        // The samples are in the fragments, the tables stay empty.
+                        size_t stts = begin_full_box(init, "stts", 0, 0);
+                        put_u32(init, 0);
+                        end_box(init, stts);
+                        size_t stsc = begin_full_box(init, "stsc", 0, 0);
+                        put_u32(init, 0);
+                        end_box(init, stsc);
+                        size_t stsz = begin_full_box(init, "stsz", 0, 0);
+                        put_u32(init, 0);
+                        put_u32(init, 0);
+                        end_box(init, stsz);
+                        size_t stco = begin_full_box(init, "stco", 0, 0);
+                        put_u32(init, 0);
+                        end_box(init, stco);
+                    }
+                    end_box(init, stbl);
+                }
+                end_box(init, minf);
+            }
+            end_box(init, mdia);
+        }
+        end_box(init, trak);
+
+        size_t mvex = begin_box(init, "mvex");
+        size_t trex = begin_full_box(init, "trex", 0, 0);
+        put_u32(init, 1);   // track_ID
+        put_u32(init, 1);   // default_sample_description_index
+        put_u32(init, 0);
+        put_u32(init, 0);
+        put_u32(init, 0);
+        end_box(init, trex);
+        end_box(init, mvex);
+    }
+    end_box(init, moov);
+
+    return true;
+}
+
+const std::string &Mp4Muxer::add_frame(const uint8_t *data, size_t size, bool key_frame, uint32_t duration)
+{
+    fragment.clear();
+
+    size_t moof = begin_box(fragment, "moof");
+    size_t mfhd = begin_full_box(fragment, "mfhd", 0, 0);
+    put_u32(fragment, sequence++);
+    end_box(fragment, mfhd);
+
+    size_t traf = begin_box(fragment, "traf");
+    // default-base-is-moof: the data offset counts from the moof box.
+    size_t tfhd = begin_full_box(fragment, "tfhd", 0, 0x020000);
+    put_u32(fragment, 1);
+    end_box(fragment, tfhd);
+
+    size_t tfdt = begin_full_box(fragment, "tfdt", 1, 0);
+    put_u64(fragment, decode_time);
+    end_box(fragment, tfdt);
+
+    // One sample: data offset, duration, size and flags.
+    size_t trun = begin_full_box(fragment, "trun", 0, 0x000701);
+    put_u32(fragment, 1);
+    size_t data_offset = fragment.size();
+    put_u32(fragment, 0);
+    put_u32(fragment, duration);
+    put_u32(fragment, (uint32_t)size);
+    // Key frames depend on no other sample, the rest are non-sync samples.
+    put_u32(fragment, key_frame ? 0x02000000 : 0x01010000);
+    end_box(fragment, trun);
+    end_box(fragment, traf);
+    end_box(fragment, moof);
+
+    // The sample starts right after the mdat header.
+    uint32_t offset = (uint32_t)(fragment.size() - moof + 8);
+    for (int i = 0; i < 4; ++i)
+        fragment[data_offset + i] = (char)((offset >> (24 - 8 * i)) & 0xFF);
+
+    put_u32(fragment, (uint32_t)(size + 8));
+    fragment.append("mdat", 4);
+    fragment.append((const char *)data, size);
+
+    decode_time += duration;
+    return fragment;
+}
@@ -0,0 +1,42 @@
+#ifndef MP4MUXER_H
+#define MP4MUXER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/** Единица времени фрагментов (тактов в секунду) */
+static const uint32_t MP4_TIMESCALE = 90000;
+
+/** Упаковщик H.264 в fragmented MP4 (ISO BMFF) для стримера
+ *   Сегмент инициализации (ftyp + moov) описывает одну видеодорожку,
+ *   каждый кадр упаковывается в отдельный фрагмент (moof + mdat), поэтому
+ *   зритель может подключиться к потоку на любом ключевом кадре.
+ *   Кадры передаются в формате AVC: NAL-блоки с 4-байтной длиной, без B-кадров.
+ */
+class Mp4Muxer
+{
+private:
+    /** Номер следующего фрагмента */
+    uint32_t sequence = 1;
+    /** Время декодирования следующего кадра, такты MP4_TIMESCALE */
+    uint64_t decode_time = 0;
+
+    std::string init;
+    std::string fragment;
+public:
+    /** Формирование сегмента инициализации
+     *   @param sps, pps - параметры потока H.264 без префикса длины
+     *   @return false, если SPS некорректен
+     */
+    bool set_config(int width, int height, const std::string &sps, const std::string &pps);
+    const std::string &get_init(void) { return init; }
+
+    /** Упаковка кадра во фрагмент
+     *   @param duration - длительность кадра в тактах MP4_TIMESCALE
+     *   @return фрагмент, действителен до следующего вызова
+     */
+    const std::string &add_frame(const uint8_t *data, size_t size, bool key_frame, uint32_t duration);
+};
+
+#endif // MP4MUXER_H
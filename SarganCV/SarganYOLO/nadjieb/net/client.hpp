@@ -0,0 +1,419 @@
+#pragma once
+
+#include <nadjieb/net/frame.hpp>
+#include <nadjieb/net/socket.hpp>
+#include <nadjieb/utils/non_copyable.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+namespace nadjieb {
+namespace net {
+
+enum class WriteResult { DONE, BLOCKED, FAILED };
+
+// How frames are framed on the connection: multipart/x-mixed-replace parts,
+// WebSocket messages, server-sent events or media stream chunks, both already
+// formatted by the publisher.
+enum class Transport { MULTIPART, WEBSOCKET, EVENT_STREAM, MEDIA };
+
+// Zero-copy is turned off for a client after this many sends the kernel copied
+// anyway (loopback, devices without scatter-gather).
+constexpr int ZEROCOPY_COPIED_LIMIT = 16;
+
+// A closed client keeps the frames of unfinished zero-copy sends this long at
+// most; then its connection is reset, which drops the send queue.
+constexpr std::chrono::seconds ZEROCOPY_LINGER{10};
+// Their completions are read this often.
+constexpr int ZEROCOPY_REAP_INTERVAL_MS = 50;
+
+// Per-connection write state. A client holds at most one frame in flight and one
+// pending frame; a newer frame replaces a pending one that has not started yet, so
+// a slow viewer skips frames instead of building a backlog. Writes are non-blocking
+// and resume from the saved offset after a partial send.
+//
+// The pending frame is a "latest frame" slot behind its own mutex, held only for a
+// pointer swap; std::atomic_exchange() on a shared_ptr would take a mutex of the
+// shared libstdc++ pool instead. The scheduled flag makes sure a client sits in at
+// most one run queue, so publishing never waits for a write in progress.
+class Client : public nadjieb::utils::NonCopyable {
+   public:
+    explicit Client(SocketFD sockfd, Transport transport = Transport::MULTIPART)
+        : sockfd_(sockfd), transport_(transport), connected_at_(std::chrono::steady_clock::now()) {}
+
+    SocketFD getFD() const { return sockfd_; }
+
+    Transport getTransport() const { return transport_; }
+
+    // Frames of at least `threshold` bytes are sent with MSG_ZEROCOPY where it is
+    // available. Such a frame is kept alive until the kernel reports the send done.
+    void enableZeroCopy(size_t threshold) {
+#ifdef NADJIEB_MJPEG_STREAMER_ZEROCOPY
+        std::unique_lock<std::mutex> write_lock(write_mtx_);
+        zerocopy_threshold_ = (threshold > 0 && setSocketZeroCopy(sockfd_)) ? threshold : 0;
+#else
+        (void)threshold;
+#endif
+    }
+
+    // Frame rate limit of the client, 0 for every frame.
+    void setMaxFps(double max_fps) {
+        interval_ = (max_fps > 0.0) ? int64_t(1e9 / max_fps) : 0;
+    }
+
+    // True if a frame published now would be taken under the rate limit, so a
+    // lazy topic knows whether producing it is worth it.
+    bool isDue(std::chrono::steady_clock::time_point now) const {
+        const auto interval = interval_.load();
+        return (interval <= 0) || (toNanoseconds(now) >= next_due_.load() - interval / 4);
+    }
+
+    // Claims the frame slot of the rate limit; a frame published in between is
+    // skipped for this client before it is pushed, so it costs neither a worker
+    // wakeup nor a send.
+    bool takeSlot(std::chrono::steady_clock::time_point now) {
+        const auto interval = interval_.load();
+        if (interval <= 0) {
+            return true;
+        }
+
+        const auto t = toNanoseconds(now);
+        auto due = next_due_.load();
+        while (true) {
+            // A quarter interval of slack absorbs the jitter of the producer.
+            if (t < due - interval / 4) {
+                ++frames_skipped_;
+                return false;
+            }
+
+            // Keep the cadence unless the client fell a whole interval behind.
+            const auto next = (t - due < interval) ? due + interval : t + interval;
+            if (next_due_.compare_exchange_weak(due, next)) {
+                return true;
+            }
+        }
+    }
+
+    // Returns true if the caller has to schedule the client for writing.
+    bool push(FramePtr frame) {
+        // A frame replaced before it was sent is dropped for backpressure. A media
+        // fragment dropped this way breaks the decoding chain: the client skips
+        // the stream up to the next key frame.
+        if (exchangePending(std::move(frame))) {
+            ++frames_dropped_;
+            if (transport_ == Transport::MEDIA) {
+                broken_ = true;
+            }
+        }
+
+        return !scheduled_.exchange(true);
+    }
+
+    // Called by the scheduler once flush() is DONE. Returns true if a frame
+    // arrived meanwhile and the client has to be flushed again.
+    bool finish() {
+        scheduled_.store(false);
+
+        // A frame pushed before the flag was cleared did not schedule the client.
+        return hasPending() && !scheduled_.exchange(true);
+    }
+
+    // Sends as much as the socket accepts without blocking.
+    WriteResult flush() {
+        std::unique_lock<std::mutex> write_lock(write_mtx_);
+        if (closed_) {
+            return WriteResult::FAILED;
+        }
+
+#ifdef NADJIEB_MJPEG_STREAMER_ZEROCOPY
+        reapZeroCopy(sockfd_);
+#endif
+
+        while (true) {
+            if (!current_) {
+                if (oneshot_) {
+                    return WriteResult::DONE;
+                }
+
+                current_ = exchangePending(FramePtr());
+                offset_ = 0;
+                if (!current_) {
+                    return WriteResult::DONE;
+                }
+                sending_ = true;
+
+                if (transport_ == Transport::MEDIA) {
+                    if (current_->isKeyFrame()) {
+                        broken_ = false;
+                    } else if (broken_ || !init_sent_) {
+                        ++frames_dropped_;
+                        current_.reset();
+                        continue;
+                    }
+
+                    // The first key frame goes out with the initialization segment.
+                    with_init_ = !init_sent_ && current_->getInit();
+                    init_sent_ = true;
+                }
+            }
+
+            // The message of the frame: the part header and the image for multipart
+            // streams, the binary message and the optional metadata text message
+            // for WebSocket, the bare event or fragment for event and media streams.
+            // The send resumes at offset_ within it.
+            SocketBuffer segments[4];
+            size_t segment_count = 0;
+            const auto& body = current_->getBuffer();
+            if (oneshot_) {
+                segments[segment_count++] = {response_header_.data(), response_header_.size()};
+                segments[segment_count++] = {body.data(), body.size()};
+            } else if (transport_ == Transport::WEBSOCKET) {
+                const auto& header = current_->getWebSocketHeader();
+                segments[segment_count++] = {header.data(), header.size()};
+                segments[segment_count++] = {body.data(), body.size()};
+                const auto& metadata = current_->getMetadata();
+                if (!metadata.empty()) {
+                    const auto& metadata_header = current_->getWebSocketMetadataHeader();
+                    segments[segment_count++] = {metadata_header.data(), metadata_header.size()};
+                    segments[segment_count++] = {metadata.data(), metadata.size()};
+                }
+            } else if (transport_ == Transport::EVENT_STREAM) {
+                segments[segment_count++] = {body.data(), body.size()};
+            } else if (transport_ == Transport::MEDIA) {
+                if (with_init_) {
+                    const auto& init = *current_->getInit();
+                    segments[segment_count++] = {init.data(), init.size()};
+                }
+                segments[segment_count++] = {body.data(), body.size()};
+            } else {
+                const auto& header = current_->getHeader();
+                segments[segment_count++] = {header.data(), header.size()};
+                segments[segment_count++] = {body.data(), body.size()};
+            }
+
+            SocketBuffer buffers[4];
+            size_t count = 0;
+            size_t total = 0;
+            for (size_t i = 0; i < segment_count; ++i) {
+                const auto size = segments[i].size;
+                if (offset_ < total + size) {
+                    const auto skip = (offset_ > total) ? offset_ - total : 0;
+                    buffers[count++] = {segments[i].data + skip, size - skip};
+                }
+                total += size;
+            }
+
+            int flags = 0;
+#ifdef NADJIEB_MJPEG_STREAMER_ZEROCOPY
+            const bool zerocopy = !oneshot_ && zerocopy_threshold_ > 0 && body.size() >= zerocopy_threshold_;
+            if (zerocopy) {
+                flags |= MSG_ZEROCOPY;
+            }
+#endif
+
+            auto sent = sendBuffersViaSocket(sockfd_, buffers, count, flags);
+#ifdef NADJIEB_MJPEG_STREAMER_ZEROCOPY
+            // Out of pinned page budget (optmem_max): copy this time.
+            if (zerocopy && sent == NADJIEB_MJPEG_STREAMER_SOCKET_ERROR && errno == ENOBUFS) {
+                sent = sendBuffersViaSocket(sockfd_, buffers, count, 0);
+            } else if (zerocopy && sent > 0) {
+                // Every successful zero-copy send takes the next completion id.
+                in_flight_.emplace_back(next_zerocopy_id_++, current_);
+            }
+#endif
+            if (sent == NADJIEB_MJPEG_STREAMER_SOCKET_ERROR) {
+                if (NADJIEB_MJPEG_STREAMER_ERRNO == NADJIEB_MJPEG_STREAMER_EWOULDBLOCK) {
+                    return WriteResult::BLOCKED;
+                }
+                return WriteResult::FAILED;
+            }
+
+            offset_ += sent;
+            bytes_sent_ += sent;
+            if (offset_ >= total) {
+                ++frames_sent_;
+                sending_ = false;
+                current_.reset();
+                if (oneshot_) {
+                    shutdownSocketWrite(sockfd_);
+                }
+            }
+        }
+    }
+
+    // One-shot response: the header followed by the frame body, after which the
+    // connection is shut down for writing. The client takes no published frames.
+    void respond(std::string&& header, FramePtr body) {
+        std::unique_lock<std::mutex> write_lock(write_mtx_);
+        response_header_ = std::move(header);
+        current_ = std::move(body);
+        offset_ = 0;
+        oneshot_ = true;
+    }
+
+    // Counters for statistics, read without locking.
+    uint64_t getFramesSent() const { return frames_sent_; }
+
+    uint64_t getFramesDropped() const { return frames_dropped_; }
+
+    uint64_t getFramesSkipped() const { return frames_skipped_; }
+
+    uint64_t getBytesSent() const { return bytes_sent_; }
+
+    // Frames waiting for the socket: one being sent and one pending at most.
+    size_t getQueueDepth() const { return (sending_ ? 1 : 0) + (hasPending() ? 1 : 0); }
+
+    double getMaxFps() const {
+        const auto interval = interval_.load();
+        return (interval > 0) ? 1e9 / interval : 0.0;
+    }
+
+    std::chrono::steady_clock::time_point getConnectedAt() const { return connected_at_; }
+
+    // Called before the socket is closed; waits for a write in progress. Frames of
+    // unfinished zero-copy sends stay in flight, see lingerZeroCopy().
+    void close() {
+        std::unique_lock<std::mutex> write_lock(write_mtx_);
+        closed_ = true;
+        sending_ = false;
+        current_.reset();
+        exchangePending(FramePtr());
+    }
+
+    bool isClosed() {
+        std::unique_lock<std::mutex> write_lock(write_mtx_);
+        return closed_;
+    }
+
+#ifdef NADJIEB_MJPEG_STREAMER_ZEROCOPY
+    // After close(): the kernel may still read frames of unfinished zero-copy
+    // sends. Keeps a duplicate of the socket, so the connection and its error
+    // queue outlive the listener's close, and finishes the connection with FIN.
+    // Returns false when nothing is in flight and the client can go right away.
+    bool lingerZeroCopy() {
+        std::unique_lock<std::mutex> write_lock(write_mtx_);
+        reapZeroCopy(sockfd_);
+        if (!in_flight_.empty()) {
+            linger_fd_ = duplicateSocket(sockfd_);
+        }
+        if (linger_fd_ == NADJIEB_MJPEG_STREAMER_INVALID_SOCKET) {
+            in_flight_.clear();
+            return false;
+        }
+
+        shutdownSocketWrite(linger_fd_);
+        linger_until_ = std::chrono::steady_clock::now() + ZEROCOPY_LINGER;
+        return true;
+    }
+
+    // Reads the completions of a lingering client. Returns true once the frames
+    // are released and the duplicate is closed; with `force` or after
+    // ZEROCOPY_LINGER the connection is reset first.
+    bool reapLingering(bool force = false) {
+        std::unique_lock<std::mutex> write_lock(write_mtx_);
+        reapZeroCopy(linger_fd_);
+        if (in_flight_.empty()) {
+            closeSocket(linger_fd_);
+        } else if (force || std::chrono::steady_clock::now() >= linger_until_) {
+            resetSocket(linger_fd_);
+            in_flight_.clear();
+        } else {
+            return false;
+        }
+
+        linger_fd_ = NADJIEB_MJPEG_STREAMER_INVALID_SOCKET;
+        return true;
+    }
+#endif
+
+   private:
+    // The replaced frame is released after the slot lock.
+    FramePtr exchangePending(FramePtr frame) {
+        std::unique_lock<std::mutex> pending_lock(pending_mtx_);
+        pending_.swap(frame);
+        return frame;
+    }
+
+    bool hasPending() const {
+        std::unique_lock<std::mutex> pending_lock(pending_mtx_);
+        return pending_ != nullptr;
+    }
+
+    static int64_t toNanoseconds(std::chrono::steady_clock::time_point time) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+    }
+
+    SocketFD sockfd_;
+    Transport transport_;
+
+    FramePtr pending_;
+    mutable std::mutex pending_mtx_;
+    std::atomic<bool> scheduled_{false};
+
+    // Rate limit: nanoseconds between frames and the time of the next slot.
+    std::atomic<int64_t> interval_{0};
+    std::atomic<int64_t> next_due_{0};
+
+    std::chrono::steady_clock::time_point connected_at_;
+    std::atomic<uint64_t> frames_sent_{0};
+    // Replaced while pending (slow connection) and skipped for the rate limit.
+    std::atomic<uint64_t> frames_dropped_{0};
+    std::atomic<uint64_t> frames_skipped_{0};
+    std::atomic<uint64_t> bytes_sent_{0};
+    std::atomic<bool> sending_{false};
+
+    std::mutex write_mtx_;
+    FramePtr current_;
+    size_t offset_ = 0;
+    bool closed_ = false;
+    bool oneshot_ = false;
+    std::string response_header_;
+
+    // Media streams: set by the publisher when a fragment was lost.
+    std::atomic<bool> broken_{false};
+    bool init_sent_ = false;
+    bool with_init_ = false;
+
+#ifdef NADJIEB_MJPEG_STREAMER_ZEROCOPY
+    size_t zerocopy_threshold_ = 0;
+    uint32_t next_zerocopy_id_ = 0;
+    int zerocopy_copied_ = 0;
+    // Frames the kernel may still read from, by completion id.
+    std::deque<std::pair<uint32_t, FramePtr>> in_flight_;
+    SocketFD linger_fd_ = NADJIEB_MJPEG_STREAMER_INVALID_SOCKET;
+    std::chrono::steady_clock::time_point linger_until_;
+
+    void reapZeroCopy(SocketFD sockfd) {
+        bool completion;
+        uint32_t first;
+        uint32_t last;
+        bool copied;
+        while (readZeroCopyCompletion(sockfd, completion, first, last, copied)) {
+            if (!completion) {
+                continue;
+            }
+
+            // Ids wrap around; the range is inclusive.
+            for (auto it = in_flight_.begin(); it != in_flight_.end();) {
+                if (uint32_t(it->first - first) <= uint32_t(last - first)) {
+                    it = in_flight_.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+
+            if (copied && ++zerocopy_copied_ >= ZEROCOPY_COPIED_LIMIT) {
+                zerocopy_threshold_ = 0;
+            }
+        }
+    }
+#endif
+};
+}  // namespace net
+}  // namespace nadjieb
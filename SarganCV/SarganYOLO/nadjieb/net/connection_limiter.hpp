@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace nadjieb {
+namespace net {
+// Open connections counted in total and by client address, shared by all the
+// listeners of a port so the caps hold whichever thread accepts a connection.
+class ConnectionLimiter {
+   public:
+    // 0 means no limit.
+    void setLimits(size_t max_connections, size_t max_connections_per_ip) {
+        std::unique_lock<std::mutex> lock(mtx_);
+        max_connections_ = max_connections;
+        max_connections_per_ip_ = max_connections_per_ip;
+    }
+
+    // Counts the connection if it is within the caps.
+    bool acquire(const std::string& peer) {
+        std::unique_lock<std::mutex> lock(mtx_);
+        if (max_connections_ > 0 && connections_ >= max_connections_) {
+            ++rejected_connections_;
+            return false;
+        }
+
+        auto& count = connections_by_ip_[peer];
+        if (max_connections_per_ip_ > 0 && count >= max_connections_per_ip_) {
+            if (count == 0) {
+                connections_by_ip_.erase(peer);
+            }
+            ++rejected_per_ip_;
+            return false;
+        }
+
+        ++count;
+        ++connections_;
+        return true;
+    }
+
+    void release(const std::string& peer) {
+        std::unique_lock<std::mutex> lock(mtx_);
+        auto it = connections_by_ip_.find(peer);
+        if (it == connections_by_ip_.end()) {
+            return;
+        }
+
+        if (--it->second == 0) {
+            connections_by_ip_.erase(it);
+        }
+        --connections_;
+    }
+
+    uint64_t getRejectedConnections() const { return rejected_connections_; }
+
+    uint64_t getRejectedPerIP() const { return rejected_per_ip_; }
+
+   private:
+    std::mutex mtx_;
+    size_t max_connections_ = 0;
+    size_t max_connections_per_ip_ = 0;
+    size_t connections_ = 0;
+    std::unordered_map<std::string, size_t> connections_by_ip_;
+    std::atomic<uint64_t> rejected_connections_{0};
+    std::atomic<uint64_t> rejected_per_ip_{0};
+};
+}  // namespace net
+}  // namespace nadjieb
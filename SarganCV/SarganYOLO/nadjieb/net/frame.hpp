@@ -0,0 +1,128 @@
+#pragma once
+
+#include <nadjieb/net/websocket.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <utility>
+
+namespace nadjieb {
+namespace net {
+// A moment on both clocks: the monotonic one for intervals on this host, the
+// wall clock to compare with other hosts.
+struct Timestamp {
+    std::chrono::steady_clock::time_point monotonic;
+    std::chrono::system_clock::time_point wall;
+
+    static Timestamp now() { return {std::chrono::steady_clock::now(), std::chrono::system_clock::now()}; }
+
+    bool isSet() const { return monotonic.time_since_epoch().count() != 0; }
+
+    // Header value: "wall=1697712345.123456; monotonic=8123.456789", seconds
+    // since the Unix epoch and since an unspecified point (boot on Linux).
+    std::string toHeaderValue() const {
+        char value[80];
+        auto length = snprintf(
+            value,
+            sizeof(value),
+            "wall=%.6f; monotonic=%.6f",
+            std::chrono::duration<double>(wall.time_since_epoch()).count(),
+            std::chrono::duration<double>(monotonic.time_since_epoch()).count());
+        return std::string(value, length);
+    }
+};
+
+// What the pipeline knows about a frame: its number and when it was captured.
+// Unset fields are filled in by the publisher: the number of the frame within
+// its topic and the publish time.
+struct FrameInfo {
+    uint64_t id = 0;
+    Timestamp captured;
+};
+
+// Encoded frame shared by every client of a topic. It is never modified after
+// publishing, so workers send it without copying or locking.
+class Frame {
+   public:
+    explicit Frame(
+        std::string&& buffer,
+        uint64_t id = 0,
+        std::string&& metadata = std::string(),
+        const Timestamp& captured = Timestamp())
+        : buffer_(std::move(buffer)),
+          id_(id),
+          metadata_(std::move(metadata)),
+          published_(Timestamp::now()),
+          captured_(captured.isSet() ? captured : published_) {
+        // Viewers tell the age of a frame and skipped frames from the part header.
+        header_
+            = "--nadjiebmjpegstreamer\r\n"
+              "Content-Type: image/jpeg\r\n"
+              "Content-Length: "
+              + std::to_string(buffer_.size())
+              + "\r\n"
+                "X-Frame-Id: "
+              + std::to_string(id_)
+              + "\r\n"
+                "X-Capture-Timestamp: "
+              + captured_.toHeaderValue()
+              + "\r\n"
+                "X-Publish-Timestamp: "
+              + published_.toHeaderValue() + "\r\n\r\n";
+        websocket_header_ = makeWebSocketHeader(WEBSOCKET_OPCODE_BINARY, buffer_.size());
+        if (!metadata_.empty()) {
+            websocket_metadata_header_ = makeWebSocketHeader(WEBSOCKET_OPCODE_TEXT, metadata_.size());
+        }
+    }
+
+    // Fragment of a media stream (e.g. fragmented MP4), already framed for the
+    // connection. A client may only start at a key frame, which carries the
+    // initialization segment of the stream for joining clients.
+    Frame(std::string&& buffer, uint64_t id, bool key_frame, std::shared_ptr<const std::string> init)
+        : buffer_(std::move(buffer)), id_(id), key_frame_(key_frame), init_(std::move(init)) {}
+
+    // Multipart part header, built once per frame instead of once per client.
+    const std::string& getHeader() const { return header_; }
+
+    const std::string& getBuffer() const { return buffer_; }
+
+    // Text (JSON) describing the frame, e.g. detections; WebSocket clients get it
+    // as a text message right after the binary one with the image.
+    const std::string& getMetadata() const { return metadata_; }
+
+    const std::string& getWebSocketHeader() const { return websocket_header_; }
+
+    const std::string& getWebSocketMetadataHeader() const { return websocket_metadata_header_; }
+
+    bool isKeyFrame() const { return key_frame_; }
+
+    // Initialization segment of a media stream, nullptr for images.
+    const std::shared_ptr<const std::string>& getInit() const { return init_; }
+
+    // Sequence number of the frame from the pipeline or within its topic, the
+    // same for all variants.
+    uint64_t getId() const { return id_; }
+
+    const Timestamp& getCaptureTime() const { return captured_; }
+
+    const Timestamp& getPublishTime() const { return published_; }
+
+   private:
+    std::string buffer_;
+    uint64_t id_;
+    std::string metadata_;
+    Timestamp published_;
+    Timestamp captured_;
+    std::string header_;
+    std::string websocket_header_;
+    std::string websocket_metadata_header_;
+    bool key_frame_ = true;
+    std::shared_ptr<const std::string> init_;
+};
+
+using FramePtr = std::shared_ptr<const Frame>;
+}  // namespace net
+}  // namespace nadjieb
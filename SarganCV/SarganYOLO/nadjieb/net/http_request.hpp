@@ -1,62 +1,159 @@
 #pragma once
 
-#include <sstream>
-#include <string>
-#include <unordered_map>
+#include <array>
+#include <cstddef>
+#include <string_view>
+#include <utility>
 
 // Reference https://developer.mozilla.org/en-US/docs/Web/HTTP/Messages#http_requests
 
 namespace nadjieb {
 namespace net {
+// Request line and headers have to fit in this many bytes.
+constexpr size_t HTTP_REQUEST_MAX_SIZE = 8192;
+constexpr size_t HTTP_REQUEST_MAX_HEADERS = 32;
+
+enum class ParseResult { INCOMPLETE, COMPLETE, TOO_LARGE, BAD_REQUEST };
+
+// Incremental request parser of one connection. Data is read straight into the
+// fixed buffer of the parser; once the header is complete the request line and
+// header fields are exposed as views into that buffer, so parsing allocates
+// nothing. The views stay valid until reset().
 class HTTPRequest {
    public:
-    HTTPRequest(const std::string& message) { parse(message); }
+    HTTPRequest() = default;
+    HTTPRequest(const HTTPRequest&) = delete;
+    HTTPRequest& operator=(const HTTPRequest&) = delete;
+
+    // Free space for the next read.
+    char* data() { return buffer_.data() + size_; }
+    size_t space() const { return buffer_.size() - size_; }
+
+    // Accounts for `size` bytes read into data(). Bytes after the header (a body
+    // or a pipelined request) are not kept.
+    ParseResult commit(size_t size) {
+        size_ += size;
+
+        // The terminator may span two reads.
+        std::string_view received(buffer_.data(), size_);
+        auto end = received.find("\r\n\r\n", (scanned_ > 3) ? scanned_ - 3 : 0);
+        if (end == std::string_view::npos) {
+            scanned_ = size_;
+            return (size_ == buffer_.size()) ? ParseResult::TOO_LARGE : ParseResult::INCOMPLETE;
+        }
+
+        return parse(received.substr(0, end + 2));
+    }
 
-    void parse(const std::string& message) {
-        std::istringstream iss(message);
+    void reset() {
+        size_ = 0;
+        scanned_ = 0;
+        header_count_ = 0;
+        method_ = target_ = version_ = std::string_view();
+    }
 
-        std::getline(iss, method_, ' ');
-        std::getline(iss, target_, ' ');
-        std::getline(iss, version_, '\r');
+    std::string_view getMethod() const { return method_; }
 
-        std::string line;
-        std::getline(iss, line);
+    std::string_view getTarget() const { return target_; }
 
-        while (true) {
-            std::getline(iss, line);
-            if (line == "\r") {
-                break;
-            }
+    std::string_view getVersion() const { return version_; }
 
-            std::string key;
-            std::string value;
-            std::istringstream iss_header(line);
-            std::getline(iss_header, key, ':');
-            std::getline(iss_header, value, ' ');
-            std::getline(iss_header, value, '\r');
+    // Target without the query string.
+    std::string_view getPath() const { return target_.substr(0, target_.find('?')); }
 
-            headers_[key] = value;
+    // Query string without the leading '?', empty if there is none.
+    std::string_view getQuery() const {
+        auto pos = target_.find('?');
+        return (pos == std::string_view::npos) ? std::string_view() : target_.substr(pos + 1);
+    }
+
+    // Header field names are case-insensitive; empty if the field is missing.
+    std::string_view getValue(std::string_view key) const {
+        for (size_t i = 0; i < header_count_; ++i) {
+            if (equalsIgnoreCase(headers_[i].first, key)) {
+                return headers_[i].second;
+            }
         }
 
-        body_ = iss.str().substr(iss.tellg());
+        return std::string_view();
     }
 
-    const std::string& getMethod() const { return method_; }
+   private:
+    std::array<char, HTTP_REQUEST_MAX_SIZE> buffer_;
+    size_t size_ = 0;
+    size_t scanned_ = 0;
+
+    std::string_view method_;
+    std::string_view target_;
+    std::string_view version_;
+    std::array<std::pair<std::string_view, std::string_view>, HTTP_REQUEST_MAX_HEADERS> headers_;
+    size_t header_count_ = 0;
+
+    // `header` holds the request line and the fields, each line ending with CRLF.
+    ParseResult parse(std::string_view header) {
+        auto line_end = header.find("\r\n");
+        auto line = header.substr(0, line_end);
+        header.remove_prefix(line_end + 2);
+
+        auto method_end = line.find(' ');
+        auto target_end = line.find(' ', method_end + 1);
+        if (method_end == 0 || method_end == std::string_view::npos || target_end == std::string_view::npos
+            || target_end == method_end + 1) {
+            return ParseResult::BAD_REQUEST;
+        }
+
+        method_ = line.substr(0, method_end);
+        target_ = line.substr(method_end + 1, target_end - method_end - 1);
+        version_ = line.substr(target_end + 1);
+        if (version_.substr(0, 5) != "HTTP/") {
+            return ParseResult::BAD_REQUEST;
+        }
+
+        while (!header.empty()) {
+            line_end = header.find("\r\n");
+            line = header.substr(0, line_end);
+            header.remove_prefix(line_end + 2);
 
-    const std::string& getTarget() const { return target_; }
+            auto colon = line.find(':');
+            if (colon == 0 || colon == std::string_view::npos) {
+                return ParseResult::BAD_REQUEST;
+            }
 
-    const std::string& getVersion() const { return version_; }
+            if (header_count_ == headers_.size()) {
+                return ParseResult::TOO_LARGE;
+            }
 
-    const std::string& getValue(const std::string& key) { return headers_[key]; }
+            headers_[header_count_++] = std::make_pair(line.substr(0, colon), trim(line.substr(colon + 1)));
+        }
 
-    const std::string& getBody() const { return body_; }
+        return ParseResult::COMPLETE;
+    }
 
-   private:
-    std::string method_;
-    std::string target_;
-    std::string version_;
-    std::unordered_map<std::string, std::string> headers_;
-    std::string body_;
+    static std::string_view trim(std::string_view value) {
+        while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) {
+            value.remove_prefix(1);
+        }
+        while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) {
+            value.remove_suffix(1);
+        }
+        return value;
+    }
+
+    static bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+        if (a.size() != b.size()) {
+            return false;
+        }
+
+        for (size_t i = 0; i < a.size(); ++i) {
+            auto ca = (a[i] >= 'A' && a[i] <= 'Z') ? char(a[i] - 'A' + 'a') : a[i];
+            auto cb = (b[i] >= 'A' && b[i] <= 'Z') ? char(b[i] - 'A' + 'a') : b[i];
+            if (ca != cb) {
+                return false;
+            }
+        }
+
+        return true;
+    }
 };
 }  // namespace net
 }  // namespace nadjieb
@@ -1,24 +1,39 @@
 #pragma once
 
+#include <nadjieb/net/connection_limiter.hpp>
+#include <nadjieb/net/http_request.hpp>
+#include <nadjieb/net/poller.hpp>
 #include <nadjieb/net/socket.hpp>
+#include <nadjieb/net/websocket.hpp>
 #include <nadjieb/utils/non_copyable.hpp>
 #include <nadjieb/utils/runnable.hpp>
+#include <nadjieb/utils/thread_priority.hpp>
 
+#include <atomic>
+#include <cstdint>
 #include <functional>
 #include <iostream>
+#include <memory>
 #include <stdexcept>
+#include <string>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
 namespace nadjieb {
 namespace net {
 
+// Parsers of closed connections kept for reuse by a burst of reconnects.
+constexpr size_t HTTP_REQUEST_POOL_SIZE = 64;
+
 struct OnMessageCallbackResponse {
     bool close_conn = false;
     bool end_listener = false;
+    // The connection switched to WebSocket; what arrives next is not HTTP.
+    bool upgraded = false;
 };
 
-using OnMessageCallback = std::function<OnMessageCallbackResponse(const SocketFD&, const std::string&)>;
+using OnMessageCallback = std::function<OnMessageCallbackResponse(const SocketFD&, const HTTPRequest&)>;
 using OnBeforeCloseCallback = std::function<void(const SocketFD&)>;
 
 class Listener : public nadjieb::utils::NonCopyable, public nadjieb::utils::Runnable {
@@ -35,8 +50,44 @@ class Listener : public nadjieb::utils::NonCopyable, public nadjieb::utils::Runn
         return *this;
     }
 
+    // Fixed SO_SNDBUF for accepted sockets; 0 keeps the kernel autotuning.
+    Listener& withSendBufferSize(int size) {
+        send_buffer_size_ = size;
+        return *this;
+    }
+
+    // Caps on open connections in total and from one address; 0 means no limit.
+    // Connections over a cap get 503 right after accept and are closed.
+    Listener& withConnectionLimits(size_t max_connections, size_t max_connections_per_ip) {
+        limiter_->setLimits(max_connections, max_connections_per_ip);
+        return *this;
+    }
+
+    // Listeners of one port share the counters of their connections.
+    Listener& withConnectionLimiter(const std::shared_ptr<ConnectionLimiter>& limiter) {
+        limiter_ = limiter;
+        return *this;
+    }
+
+    // Binds with SO_REUSEPORT, so several listeners can share the port and the
+    // kernel spreads the connections across them.
+    Listener& withReusePort(bool reuse_port) {
+        reuse_port_ = reuse_port;
+        return *this;
+    }
+
+    Listener& withNiceness(int niceness) {
+        niceness_ = niceness;
+        return *this;
+    }
+
+    uint64_t getRejectedConnections() const { return limiter_->getRejectedConnections(); }
+
+    uint64_t getRejectedPerIP() const { return limiter_->getRejectedPerIP(); }
+
     void stop() {
         end_listener_ = true;
+        poller_.wakeup();
         if (thread_listener_.joinable()) {
             thread_listener_.join();
         }
@@ -46,6 +97,7 @@ class Listener : public nadjieb::utils::NonCopyable, public nadjieb::utils::Runn
 
     void run(int port) {
         state_ = nadjieb::utils::State::BOOTING;
+        nadjieb::utils::lowerThreadPriority(niceness_);
         panicIfUnexpected(on_message_cb_ == nullptr, "not setting on_message_cb");
         panicIfUnexpected(on_before_close_cb_ == nullptr, "not setting on_before_close_cb");
 
@@ -54,45 +106,34 @@ class Listener : public nadjieb::utils::NonCopyable, public nadjieb::utils::Runn
         initSocket();
         listen_sd_ = createSocket(AF_INET, SOCK_STREAM, 0);
         setSocketReuseAddress(listen_sd_);
+#ifdef NADJIEB_MJPEG_STREAMER_REUSEPORT
+        if (reuse_port_) {
+            setSocketReusePort(listen_sd_);
+        }
+#endif
         setSocketNonblock(listen_sd_);
         bindSocket(listen_sd_, "0.0.0.0", port);
         listenOnSocket(listen_sd_, SOMAXCONN);
 
-        fds_.emplace_back(NADJIEB_MJPEG_STREAMER_POLLFD{listen_sd_, POLLRDNORM, 0});
+        poller_.add(listen_sd_, POLLER_READ);
 
-        std::string buff(4096, 0);
+        std::vector<PollEvent> events;
+
+        // With epoll stop() wakes the loop up, otherwise it is noticed on timeout.
+        const int timeout = Poller::canWakeup() ? -1 : 100;
 
         state_ = nadjieb::utils::State::RUNNING;
 
         while (!end_listener_) {
-            int socket_count = pollSockets(&fds_[0], fds_.size(), 100);
+            int socket_count = poller_.wait(events, timeout);
 
             panicIfUnexpected(socket_count == NADJIEB_MJPEG_STREAMER_SOCKET_ERROR, "pollSockets() failed");
 
-            if (socket_count == 0) {
-                continue;
-            }
-
-            size_t current_size = fds_.size();
-            bool compress_array = false;
-            for (size_t i = 0; i < current_size; ++i) {
-                if (fds_[i].revents == 0) {
-                    continue;
-                }
-
-                if (fds_[i].revents & (POLLERR | POLLHUP | POLLNVAL)) {
-                    on_before_close_cb_(fds_[i].fd);
-                    closeSocket(fds_[i].fd);
-                    fds_[i].fd = NADJIEB_MJPEG_STREAMER_INVALID_SOCKET;
-                    compress_array = true;
-                    continue;
-                }
-
-                panicIfUnexpected(fds_[i].revents != POLLRDNORM, "revents != POLLRDNORM");
-
-                if (fds_[i].fd == listen_sd_) {
+            for (const auto& event : events) {
+                if (event.fd == listen_sd_) {
+                    std::string peer;
                     do {
-                        auto new_socket = acceptNewSocket(listen_sd_);
+                        auto new_socket = acceptNewSocket(listen_sd_, peer);
                         if (new_socket == NADJIEB_MJPEG_STREAMER_INVALID_SOCKET) {
                             panicIfUnexpected(
                                 NADJIEB_MJPEG_STREAMER_ERRNO != NADJIEB_MJPEG_STREAMER_EWOULDBLOCK, "accept() failed");
@@ -101,32 +142,81 @@ class Listener : public nadjieb::utils::NonCopyable, public nadjieb::utils::Runn
 
                         setSocketNonblock(new_socket);
 
-                        fds_.emplace_back(NADJIEB_MJPEG_STREAMER_POLLFD{new_socket, POLLRDNORM, 0});
+                        if (!limiter_->acquire(peer)) {
+                            rejectConnection(new_socket);
+                            continue;
+                        }
+
+                        setSocketNoDelay(new_socket);
+                        if (send_buffer_size_ > 0) {
+                            setSocketSendBuffer(new_socket, send_buffer_size_);
+                        }
+
+                        auto& connection = sockets_[new_socket];
+                        connection.request = acquireRequest();
+                        connection.peer = peer;
+                        poller_.add(new_socket, POLLER_READ);
                     } while (true);
-                } else {
-                    std::string data;
-                    bool close_conn = false;
+                    continue;
+                }
 
-                    do {
-                        auto size = readFromSocket(fds_[i].fd, &buff[0], buff.size(), 0);
-                        if (size == NADJIEB_MJPEG_STREAMER_SOCKET_ERROR) {
-                            if (NADJIEB_MJPEG_STREAMER_ERRNO != NADJIEB_MJPEG_STREAMER_EWOULDBLOCK) {
-                                std::cerr << "readFromSocket() failed" << std::endl;
-                                close_conn = true;
-                            }
-                            break;
+                auto it = sockets_.find(event.fd);
+                if (it == sockets_.end()) {
+                    continue;
+                }
+
+                // Zero-copy completions are reported as errors too.
+                const bool error = event.error && !hasZeroCopyCompletions(event.fd);
+                if (event.error && !event.readable) {
+                    if (error) {
+                        closeConnection(event.fd);
+                    }
+                    continue;
+                }
+
+                // The request may arrive in several reads; the parser keeps its
+                // state between readiness events.
+                auto& connection = it->second;
+                auto& request = *connection.request;
+                bool close_conn = error;
+
+                do {
+                    auto size = readFromSocket(event.fd, request.data(), request.space(), 0);
+                    if (size == NADJIEB_MJPEG_STREAMER_SOCKET_ERROR) {
+                        if (NADJIEB_MJPEG_STREAMER_ERRNO != NADJIEB_MJPEG_STREAMER_EWOULDBLOCK) {
+                            std::cerr << "readFromSocket() failed" << std::endl;
+                            close_conn = true;
                         }
+                        break;
+                    }
 
-                        if (size == 0) {
+                    if (size == 0) {
+                        close_conn = true;
+                        break;
+                    }
+
+                    // After an error response the rest of the request is read and
+                    // dropped until the peer closes, so the response is not lost
+                    // to a reset.
+                    if (connection.draining) {
+                        request.reset();
+                        continue;
+                    }
+
+                    if (connection.upgraded) {
+                        if (connection.websocket.consume(request.data(), size)) {
                             close_conn = true;
-                            break;
                         }
+                        continue;
+                    }
 
-                        data += buff.substr(0, size);
-                    } while (true);
+                    auto result = request.commit(size);
+                    if (result == ParseResult::INCOMPLETE) {
+                        continue;
+                    }
 
-                    if (!close_conn) {
-                        auto resp = on_message_cb_(fds_[i].fd, data);
+                    if (result == ParseResult::COMPLETE) {
+                        auto resp = on_message_cb_(event.fd, request);
                         if (resp.close_conn) {
                             close_conn = resp.close_conn;
                         }
@@ -134,19 +224,22 @@ class Listener : public nadjieb::utils::NonCopyable, public nadjieb::utils::Runn
                         if (resp.end_listener) {
                             end_listener_ = resp.end_listener;
                         }
-                    }
 
-                    if (close_conn) {
-                        on_before_close_cb_(fds_[i].fd);
-                        closeSocket(fds_[i].fd);
-                        fds_[i].fd = NADJIEB_MJPEG_STREAMER_INVALID_SOCKET;
-                        compress_array = true;
+                        connection.upgraded = resp.upgraded;
+                    } else {
+                        sendError(event.fd, result);
+                        shutdownSocketWrite(event.fd);
+                        connection.draining = true;
                     }
-                }
-            }
 
-            if (compress_array) {
-                compress();
+                    // Keep reading until the socket is drained: with edge-triggered
+                    // polling a hangup already received is not reported again.
+                    request.reset();
+                } while (!close_conn && !end_listener_);
+
+                if (close_conn) {
+                    closeConnection(event.fd);
+                }
             }
         }
 
@@ -155,32 +248,99 @@ class Listener : public nadjieb::utils::NonCopyable, public nadjieb::utils::Runn
 
    private:
     SocketFD listen_sd_ = NADJIEB_MJPEG_STREAMER_INVALID_SOCKET;
-    bool end_listener_ = true;
-    std::vector<NADJIEB_MJPEG_STREAMER_POLLFD> fds_;
+    std::atomic<bool> end_listener_{true};
+    int send_buffer_size_ = 0;
+    Poller poller_;
+    struct Connection {
+        std::unique_ptr<HTTPRequest> request;
+        std::string peer;
+        bool draining = false;
+        bool upgraded = false;
+        WebSocketReader websocket;
+    };
+
+    std::unordered_map<SocketFD, Connection> sockets_;
+    std::vector<std::unique_ptr<HTTPRequest>> request_pool_;
+    std::shared_ptr<ConnectionLimiter> limiter_ = std::make_shared<ConnectionLimiter>();
+    bool reuse_port_ = false;
+    int niceness_ = 0;
     OnMessageCallback on_message_cb_;
     OnBeforeCloseCallback on_before_close_cb_;
     std::thread thread_listener_;
 
-    void compress() {
-        for (auto it = fds_.begin(); it != fds_.end();) {
-            if (it->fd == NADJIEB_MJPEG_STREAMER_INVALID_SOCKET) {
-                it = fds_.erase(it);
-            } else {
-                ++it;
+    // Answers without registering the connection. Whatever part of the request
+    // has already arrived is read first, so closing does not reset the 503.
+    void rejectConnection(SocketFD sockfd) {
+        static const std::string response
+            = "HTTP/1.1 503 Service Unavailable\r\n"
+              "Retry-After: 5\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+        sendViaSocket(sockfd, response.c_str(), response.size(), 0);
+        shutdownSocketWrite(sockfd);
+
+        // Bounded, so a flood of data cannot keep the listener here.
+        char buff[1024];
+        for (int i = 0; i < 8; ++i) {
+            if (readFromSocket(sockfd, buff, sizeof(buff), 0) <= 0) {
+                break;
             }
         }
+        closeSocket(sockfd);
+    }
+
+    std::unique_ptr<HTTPRequest> acquireRequest() {
+        if (request_pool_.empty()) {
+            return std::make_unique<HTTPRequest>();
+        }
+
+        auto request = std::move(request_pool_.back());
+        request_pool_.pop_back();
+        request->reset();
+        return request;
+    }
+
+    void releaseRequest(std::unique_ptr<HTTPRequest> request) {
+        if (request && request_pool_.size() < HTTP_REQUEST_POOL_SIZE) {
+            request_pool_.push_back(std::move(request));
+        }
+    }
+
+    void sendError(SocketFD sockfd, ParseResult result) {
+        const std::string response = (result == ParseResult::TOO_LARGE)
+                                         ? "HTTP/1.1 431 Request Header Fields Too Large\r\n"
+                                           "Connection: close\r\nContent-Length: 0\r\n\r\n"
+                                         : "HTTP/1.1 400 Bad Request\r\n"
+                                           "Connection: close\r\nContent-Length: 0\r\n\r\n";
+        sendViaSocket(sockfd, response.c_str(), response.size(), 0);
+    }
+
+    void closeConnection(SocketFD sockfd) {
+        on_before_close_cb_(sockfd);
+        poller_.remove(sockfd);
+        auto it = sockets_.find(sockfd);
+        if (it != sockets_.end()) {
+            limiter_->release(it->second.peer);
+            releaseRequest(std::move(it->second.request));
+            sockets_.erase(it);
+        }
+        closeSocket(sockfd);
     }
 
     void closeAll() {
         state_ = nadjieb::utils::State::TERMINATING;
-        for (auto& pfd : fds_) {
-            if (pfd.fd >= 0) {
-                on_before_close_cb_(pfd.fd);
-                closeSocket(pfd.fd);
-            }
+        for (const auto& socket : sockets_) {
+            on_before_close_cb_(socket.first);
+            poller_.remove(socket.first);
+            closeSocket(socket.first);
+            limiter_->release(socket.second.peer);
+        }
+        sockets_.clear();
+
+        if (listen_sd_ != NADJIEB_MJPEG_STREAMER_INVALID_SOCKET) {
+            poller_.remove(listen_sd_);
+            closeSocket(listen_sd_);
+            listen_sd_ = NADJIEB_MJPEG_STREAMER_INVALID_SOCKET;
         }
 
-        fds_.clear();
         destroySocket();
         state_ = nadjieb::utils::State::TERMINATED;
     }
@@ -1,14 +1,26 @@
 #pragma once
 
+#include <nadjieb/net/client.hpp>
+#include <nadjieb/net/frame.hpp>
+#include <nadjieb/net/poller.hpp>
 #include <nadjieb/net/socket.hpp>
+#include <nadjieb/net/stats.hpp>
 #include <nadjieb/net/topic.hpp>
+#include <nadjieb/net/topic_registry.hpp>
+#include <nadjieb/net/variant.hpp>
 #include <nadjieb/utils/non_copyable.hpp>
 #include <nadjieb/utils/runnable.hpp>
+#include <nadjieb/utils/thread_priority.hpp>
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstdio>
+#include <memory>
 #include <mutex>
-#include <queue>
+#include <deque>
+#include <functional>
 #include <string>
 #include <thread>
 #include <unordered_map>
@@ -24,17 +36,27 @@ class Publisher : public nadjieb::utils::NonCopyable, public nadjieb::utils::Run
     void start(int num_workers = std::thread::hardware_concurrency()) {
         state_ = nadjieb::utils::State::BOOTING;
         end_publisher_ = false;
+        num_workers = std::max(num_workers, 1);
+        queues_.clear();
+        for (auto i = 0; i < num_workers; ++i) {
+            queues_.emplace_back(new RunQueue());
+        }
         workers_.reserve(num_workers);
         for (auto i = 0; i < num_workers; ++i) {
-            workers_.emplace_back(&Publisher::worker, this);
+            workers_.emplace_back(&Publisher::worker, this, i);
         }
+        writable_watcher_ = std::thread(&Publisher::watchWritable, this);
         state_ = nadjieb::utils::State::RUNNING;
     }
 
     void stop() {
         state_ = nadjieb::utils::State::TERMINATING;
         end_publisher_ = true;
-        condition_.notify_all();
+        for (auto& queue : queues_) {
+            std::unique_lock<std::mutex> queue_lock(queue->mtx);
+            queue->condition.notify_all();
+        }
+        write_poller_.wakeup();
 
         if (!workers_.empty()) {
             for (auto& w : workers_) {
@@ -45,113 +67,616 @@ class Publisher : public nadjieb::utils::NonCopyable, public nadjieb::utils::Run
             workers_.clear();
         }
 
+        if (writable_watcher_.joinable()) {
+            writable_watcher_.join();
+        }
+
         topics_.clear();
-        path_by_client_.clear();
 
-        while (!payloads_.empty()) {
-            payloads_.pop();
+        // Listener threads may still be closing connections.
+        std::unique_lock<std::mutex> clients_lock(clients_mtx_);
+        topic_by_client_.clear();
+        responses_.clear();
+        clients_lock.unlock();
+
+        for (auto& queue : queues_) {
+            std::unique_lock<std::mutex> queue_lock(queue->mtx);
+            queue->clients.clear();
+        }
+
+        std::unique_lock<std::mutex> blocked_lock(blocked_mtx_);
+        blocked_.clear();
+        to_watch_.clear();
+#ifdef NADJIEB_MJPEG_STREAMER_ZEROCOPY
+        for (auto& client : lingering_) {
+            client->reapLingering(true);
         }
+        lingering_.clear();
+#endif
+        blocked_lock.unlock();
+
         state_ = nadjieb::utils::State::TERMINATED;
     }
 
-    void add(const SocketFD& sockfd, const std::string& path) {
+    void add(
+        const SocketFD& sockfd,
+        const std::string& path,
+        const Variant& variant = Variant(),
+        Transport transport = Transport::MULTIPART,
+        double max_fps = 0.0) {
         if (end_publisher_) {
             return;
         }
 
-        topics_[path].addClient(sockfd);
+        auto topic = topics_.create(path);
+        auto client = topic->addClient(sockfd, variant, transport);
+        client->enableZeroCopy(zerocopy_threshold_);
+        client->setMaxFps(max_fps);
+        if (transport == Transport::MEDIA) {
+            topic->requestKeyFrame();
+        }
 
-        std::unique_lock<std::mutex> lock(path_by_client_mtx_);
-        path_by_client_[sockfd] = path;
+        std::unique_lock<std::mutex> lock(clients_mtx_);
+        topic_by_client_[sockfd] = std::move(topic);
     }
 
-    bool pathExists(const std::string& path) { return (topics_.find(path) != topics_.end()); }
+    // Registers the topic of the path, so clients can subscribe before the first
+    // frame is published. Publishing creates it as well.
+    void createTopic(const std::string& path) { topics_.create(path); }
+
+    bool pathExists(const std::string& path) { return (topics_.find(path) != nullptr); }
+
+    // Latest frame of the topic for a snapshot request, nullptr if there is none
+    // yet. The request keeps a lazy topic produced for a while.
+    FramePtr getSnapshot(const std::string& path) {
+        auto topic = topics_.find(path);
+        if (!topic) {
+            return nullptr;
+        }
+
+        topic->requestSnapshot();
+        return topic->getBuffer();
+    }
+
+    // Sends a single response on the connection through the workers, so a large
+    // body never blocks the listener. The connection is shut down afterwards.
+    void respond(const SocketFD& sockfd, std::string&& header, FramePtr body) {
+        if (end_publisher_) {
+            return;
+        }
+
+        auto client = std::make_shared<Client>(sockfd);
+        client->respond(std::move(header), std::move(body));
+
+        std::unique_lock<std::mutex> lock(clients_mtx_);
+        responses_[sockfd] = client;
+        lock.unlock();
+
+        if (client->push(nullptr)) {
+            schedule(client);
+        }
+    }
 
     void removeClient(const SocketFD& sockfd) {
-        std::unique_lock<std::mutex> lock(path_by_client_mtx_);
-        topics_[path_by_client_[sockfd]].removeClient(sockfd);
+        std::unique_lock<std::mutex> lock(clients_mtx_);
+        std::shared_ptr<Client> client;
+        auto response_it = responses_.find(sockfd);
+        if (response_it != responses_.end()) {
+            client = std::move(response_it->second);
+            responses_.erase(response_it);
+        } else {
+            auto topic_it = topic_by_client_.find(sockfd);
+            if (topic_it != topic_by_client_.end()) {
+                client = topic_it->second->removeClient(sockfd);
+                topic_by_client_.erase(topic_it);
+            }
+        }
+        lock.unlock();
+
+        if (client) {
+            // No write may touch the descriptor once the listener closes it.
+            client->close();
 
-        path_by_client_.erase(sockfd);
+            std::unique_lock<std::mutex> blocked_lock(blocked_mtx_);
+            auto it = blocked_.find(sockfd);
+            if (it != blocked_.end() && it->second == client) {
+                blocked_.erase(it);
+            }
+            // The watcher must not add the descriptor to its poller after the close.
+            to_watch_.erase(std::remove(to_watch_.begin(), to_watch_.end(), sockfd), to_watch_.end());
+
+#ifdef NADJIEB_MJPEG_STREAMER_ZEROCOPY
+            // The duplicate keeps the socket registered in the poller, remove it now.
+            if (client->lingerZeroCopy()) {
+                write_poller_.remove(sockfd);
+                lingering_.push_back(client);
+                blocked_lock.unlock();
+                write_poller_.wakeup();
+            }
+#endif
+        }
     }
 
-    void enqueue(const std::string& path, const std::string& buffer) {
+    void enqueue(const std::string& path, const std::string& buffer) { enqueue(path, std::string(buffer)); }
+
+    // The metadata goes with the frame to WebSocket clients only.
+    void enqueue(
+        const std::string& path,
+        std::string&& buffer,
+        std::string&& metadata = std::string(),
+        const FrameInfo& info = FrameInfo()) {
         if (end_publisher_) {
             return;
         }
 
-        topics_[path].setBuffer(buffer);
+        auto topic = topics_.create(path);
+        auto frame = std::make_shared<const Frame>(
+            std::move(buffer), info.id ? info.id : topic->nextFrameId(), std::move(metadata), info.captured);
+        topic->setBuffer(frame);
+        topic->countPublished();
+
+        deliver(topic->getClients(), frame);
+    }
+
+    // The producer is called only when the topic has clients due for a frame or
+    // recent snapshot requests, once per frame for all of them. The topic is
+    // registered anyway, so clients can subscribe to it.
+    bool enqueue(
+        const std::string& path,
+        const std::function<std::string()>& producer,
+        const std::string& metadata = std::string(),
+        const FrameInfo& info = FrameInfo()) {
+        if (end_publisher_) {
+            return false;
+        }
+
+        auto topic = topics_.create(path);
+        if (!topic->hasSnapshotDemand()) {
+            auto clients = topic->getClients();
+            if (clients.empty()) {
+                // Do not keep a stale frame while nobody is watching.
+                topic->setBuffer(nullptr);
+                return false;
+            }
+
+            // Every client has asked for a lower frame rate and skips this frame.
+            // Its number is used up anyway, so viewers see the gap.
+            const auto now = std::chrono::steady_clock::now();
+            if (std::none_of(clients.begin(), clients.end(), [&](const auto& c) { return c->isDue(now); })) {
+                if (!info.id) {
+                    topic->nextFrameId();
+                }
+                return false;
+            }
+        }
+
+        // An empty result skips the frame.
+        auto buffer = producer();
+        if (buffer.empty()) {
+            return false;
+        }
+
+        enqueue(path, std::move(buffer), std::string(metadata), info);
+        return true;
+    }
+
+    // Every watched variant of the topic is produced once per frame and shared by
+    // the clients that asked for it. Returns true if at least one was produced.
+    bool enqueue(
+        const std::string& path,
+        const std::function<std::string(const Variant&)>& producer,
+        const std::string& metadata = std::string(),
+        const FrameInfo& info = FrameInfo()) {
+        if (end_publisher_) {
+            return false;
+        }
+
+        auto topic = topics_.create(path);
+        auto variants = topic->getVariants();
+
+        // Snapshots are served from the default variant.
+        if (topic->hasSnapshotDemand()) {
+            auto it = std::find_if(variants.begin(), variants.end(), [](const auto& v) { return v.first.isDefault(); });
+            if (it == variants.end()) {
+                variants.emplace_back(Variant(), std::vector<std::shared_ptr<Client>>());
+            }
+        }
+
+        if (variants.empty()) {
+            topic->setBuffer(nullptr);
+            return false;
+        }
+
+        const auto id = info.id ? info.id : topic->nextFrameId();
+        const auto now = std::chrono::steady_clock::now();
+        const bool snapshot_demand = topic->hasSnapshotDemand();
+        bool produced = false;
+        for (auto& variant : variants) {
+            // A variant whose clients all skip this frame for their rate limit
+            // is not produced.
+            auto& clients = variant.second;
+            clients.erase(
+                std::remove_if(
+                    clients.begin(), clients.end(), [&](const auto& c) { return !c->takeSlot(now); }),
+                clients.end());
+            if (clients.empty() && !(snapshot_demand && variant.first.isDefault())) {
+                continue;
+            }
 
-        for (const auto& client : topics_[path].getClients()) {
-            if (topics_[path].getQueueSize(client.fd) > LIMIT_QUEUE_PER_CLIENT) {
+            auto buffer = producer(variant.first);
+            if (buffer.empty()) {
                 continue;
             }
 
-            std::unique_lock<std::mutex> payloads_lock(payloads_mtx_);
-            payloads_.emplace(path, client);
-            topics_[path].increaseQueue(client.fd);
-            payloads_lock.unlock();
+            produced = true;
+            auto frame = std::make_shared<const Frame>(std::move(buffer), id, std::string(metadata), info.captured);
+            if (variant.first.isDefault()) {
+                topic->setBuffer(frame);
+            }
+
+            for (const auto& client : clients) {
+                if (client->push(frame)) {
+                    schedule(client);
+                }
+            }
+        }
 
-            condition_.notify_one();
+        if (produced) {
+            topic->countPublished();
         }
+        return produced;
     }
 
-    bool hasClient(const std::string& path) { return topics_[path].hasClient(); }
+    // Publishes `data` as one server-sent event of the topic, which becomes an
+    // event stream. Nothing is formatted while nobody listens. A slow client
+    // skips events like it skips frames.
+    bool enqueueEvent(const std::string& path, const std::string& data) {
+        if (end_publisher_) {
+            return false;
+        }
+
+        auto topic = topics_.create(path);
+        topic->setEventStream();
+        if (!topic->hasClient()) {
+            return false;
+        }
+
+        const auto id = topic->nextFrameId();
+        std::string event = "id: " + std::to_string(id) + "\n";
+        event.reserve(event.size() + data.size() + 16);
+
+        // Every line of the data needs its own field.
+        size_t begin = 0;
+        while (true) {
+            auto end = data.find('\n', begin);
+            event += "data: ";
+            event.append(data, begin, (end == std::string::npos) ? std::string::npos : end - begin);
+            event += "\n";
+            if (end == std::string::npos) {
+                break;
+            }
+            begin = end + 1;
+        }
+        event += "\n";
+
+        topic->countPublished();
+        deliver(topic->getClients(), std::make_shared<const Frame>(std::move(event), id));
+
+        return true;
+    }
+
+    // Registers a media topic, or replaces its initialization segment when the
+    // encoder restarts. Fragments are sent with chunked transfer coding.
+    void setMediaInit(const std::string& path, const std::string& content_type, const std::string& init) {
+        topics_.create(path)->setMedia(content_type, std::make_shared<const std::string>(encodeChunk(init)));
+    }
+
+    // Publishes a fragment of a media topic. Nothing is sent while nobody
+    // watches or before the initialization segment is set.
+    bool enqueueMedia(const std::string& path, const std::string& fragment, bool key_frame) {
+        if (end_publisher_) {
+            return false;
+        }
+
+        auto topic = topics_.create(path);
+        auto init = topic->getInit();
+        if (!init || !topic->hasClient()) {
+            return false;
+        }
+
+        if (key_frame) {
+            topic->takeKeyFrameRequest();
+        }
+
+        auto frame = std::make_shared<const Frame>(encodeChunk(fragment), topic->nextFrameId(), key_frame, init);
+        topic->countPublished();
+        for (const auto& client : topic->getClients()) {
+            if (client->push(frame)) {
+                schedule(client);
+            }
+        }
+
+        return true;
+    }
+
+    // True while a client that joined the media topic waits for a key frame.
+    bool needsKeyFrame(const std::string& path) {
+        auto topic = topics_.find(path);
+        return topic && topic->hasKeyFrameRequest();
+    }
+
+    // Content type of a media topic, empty for other topics.
+    std::string getMediaType(const std::string& path) {
+        auto topic = topics_.find(path);
+        return topic ? topic->getMediaType() : std::string();
+    }
+
+    bool isEventStream(const std::string& path) {
+        auto topic = topics_.find(path);
+        return topic && topic->isEventStream();
+    }
+
+    bool hasClient(const std::string& path) {
+        auto topic = topics_.find(path);
+        return topic && topic->hasClient();
+    }
+
+    bool hasClient(const std::string& path, Transport transport) {
+        auto topic = topics_.find(path);
+        return topic && topic->hasClient(transport);
+    }
+
+    size_t getClientCount(const std::string& path) {
+        auto topic = topics_.find(path);
+        return topic ? topic->getClientCount() : 0;
+    }
+
+    // Counters of every topic, sorted by path.
+    std::vector<TopicStats> getStats() {
+        auto topics = topics_.snapshot();
+
+        std::vector<TopicStats> stats;
+        stats.reserve(topics->size());
+        for (const auto& topic : *topics) {
+            stats.push_back(topic.second->getStats());
+            stats.back().path = topic.first;
+        }
+
+        std::sort(stats.begin(), stats.end(), [](const auto& a, const auto& b) { return a.path < b.path; });
+        return stats;
+    }
+
+    // Niceness of the worker threads, applied on start().
+    void setNiceness(int niceness) { niceness_ = niceness; }
+
+    // Frames of at least this size go out with MSG_ZEROCOPY on Linux; 0 disables.
+    // Applies to clients connecting afterwards.
+    void setZeroCopyThreshold(size_t threshold) { zerocopy_threshold_ = threshold; }
 
    private:
-    typedef std::pair<std::string, NADJIEB_MJPEG_STREAMER_POLLFD> Payload;
+    // Ready clients of one worker. A client always goes to the same home worker;
+    // idle workers steal from the back of the other queues.
+    struct RunQueue {
+        std::mutex mtx;
+        std::condition_variable condition;
+        std::deque<std::shared_ptr<Client>> clients;
+        bool sleeping = false;
+        bool signaled = false;
+    };
 
-    std::condition_variable condition_;
     std::vector<std::thread> workers_;
-    std::queue<Payload> payloads_;
-    std::unordered_map<SocketFD, std::string> path_by_client_;
-    std::unordered_map<std::string, Topic> topics_;
-    std::mutex cv_mtx_;
-    std::mutex path_by_client_mtx_;
-    std::mutex payloads_mtx_;
-    bool end_publisher_ = true;
+    std::vector<std::unique_ptr<RunQueue>> queues_;
+    std::atomic<int> sleeping_{0};
+    TopicRegistry topics_;
+    // The topic of every subscribed client, resolved once when it joins.
+    std::unordered_map<SocketFD, TopicPtr> topic_by_client_;
+    // One-shot responses in flight, guarded by clients_mtx_.
+    std::unordered_map<SocketFD, std::shared_ptr<Client>> responses_;
+    std::mutex clients_mtx_;
+    std::atomic<bool> end_publisher_{true};
+    std::atomic<size_t> zerocopy_threshold_{0};
+    int niceness_ = 0;
+
+    // Clients whose socket buffer is full wait here for writability, so a slow
+    // viewer never holds a worker.
+    Poller write_poller_;
+    std::thread writable_watcher_;
+    std::unordered_map<SocketFD, std::shared_ptr<Client>> blocked_;
+    std::vector<SocketFD> to_watch_;
+    std::mutex blocked_mtx_;
+#ifdef NADJIEB_MJPEG_STREAMER_ZEROCOPY
+    // Closed clients waiting for their zero-copy completions, guarded by blocked_mtx_.
+    std::vector<std::shared_ptr<Client>> lingering_;
+#endif
+
+    // Chunk of HTTP/1.1 chunked transfer coding.
+    static std::string encodeChunk(const std::string& data) {
+        char size[20];
+        auto length = snprintf(size, sizeof(size), "%zx\r\n", data.size());
+
+        std::string chunk;
+        chunk.reserve(length + data.size() + 2);
+        chunk.append(size, length);
+        chunk.append(data);
+        chunk.append("\r\n");
+        return chunk;
+    }
 
-    const static int LIMIT_QUEUE_PER_CLIENT = 5;
+    // Pushes the frame to the clients whose rate limit lets it through.
+    void deliver(const std::vector<std::shared_ptr<Client>>& clients, const FramePtr& frame) {
+        const auto now = std::chrono::steady_clock::now();
+        for (const auto& client : clients) {
+            if (client->takeSlot(now) && client->push(frame)) {
+                schedule(client);
+            }
+        }
+    }
 
-    void worker() {
-        while (!end_publisher_) {
-            std::unique_lock<std::mutex> cv_lock(cv_mtx_);
+    void schedule(const std::shared_ptr<Client>& client) {
+        auto& home = *queues_[(size_t)client->getFD() % queues_.size()];
 
-            condition_.wait(cv_lock, [&]() { return (end_publisher_ || !payloads_.empty()); });
-            if (end_publisher_) {
-                break;
+        std::unique_lock<std::mutex> queue_lock(home.mtx);
+        home.clients.push_back(client);
+        bool wake_home = home.sleeping;
+        queue_lock.unlock();
+
+        if (wake_home) {
+            home.condition.notify_one();
+        } else if (sleeping_ > 0) {
+            // The home worker is busy, let an idle one steal the client.
+            wakeIdle();
+        }
+    }
+
+    void wakeIdle() {
+        for (auto& queue : queues_) {
+            std::unique_lock<std::mutex> queue_lock(queue->mtx);
+            if (queue->sleeping && !queue->signaled) {
+                queue->signaled = true;
+                queue_lock.unlock();
+                queue->condition.notify_one();
+                return;
             }
+        }
+    }
 
-            std::unique_lock<std::mutex> payloads_lock(payloads_mtx_);
+    std::shared_ptr<Client> take(size_t index) {
+        std::shared_ptr<Client> client;
 
-            Payload payload = std::move(payloads_.front());
-            payloads_.pop();
-            topics_[payload.first].decreaseQueue(payload.second.fd);
+        auto& own = *queues_[index];
+        std::unique_lock<std::mutex> own_lock(own.mtx);
+        if (!own.clients.empty()) {
+            client = std::move(own.clients.front());
+            own.clients.pop_front();
+            return client;
+        }
+        own_lock.unlock();
+
+        for (size_t i = 1; i < queues_.size(); ++i) {
+            auto& victim = *queues_[(index + i) % queues_.size()];
+            std::unique_lock<std::mutex> victim_lock(victim.mtx);
+            if (!victim.clients.empty()) {
+                client = std::move(victim.clients.back());
+                victim.clients.pop_back();
+                return client;
+            }
+        }
 
-            payloads_lock.unlock();
-            cv_lock.unlock();
+        return client;
+    }
 
-            auto buffer = topics_[payload.first].getBuffer();
-            std::string res_str
-                = "--nadjiebmjpegstreamer\r\n"
-                  "Content-Type: image/jpeg\r\n"
-                  "Content-Length: "
-                  + std::to_string(buffer.size()) + "\r\n\r\n" + buffer;
+    void worker(size_t index) {
+        nadjieb::utils::lowerThreadPriority(niceness_);
+        auto& own = *queues_[index];
 
-            auto socket_count = pollSockets(&payload.second, 1, 1);
+        while (!end_publisher_) {
+            auto client = take(index);
+            if (client) {
+                serve(client);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> own_lock(own.mtx);
+            own.sleeping = true;
+            ++sleeping_;
+            own.condition.wait(
+                own_lock, [&]() { return (end_publisher_ || !own.clients.empty() || own.signaled); });
+            own.sleeping = false;
+            own.signaled = false;
+            --sleeping_;
+        }
+    }
+
+    void serve(const std::shared_ptr<Client>& client) {
+        while (true) {
+            auto result = client->flush();
+
+            if (result == WriteResult::BLOCKED) {
+                // removeClient() may have run since the flush; the descriptor of a
+                // closed client may already belong to a new connection.
+                std::unique_lock<std::mutex> blocked_lock(blocked_mtx_);
+                if (client->isClosed()) {
+                    return;
+                }
+                auto entry = blocked_.emplace(client->getFD(), client);
+                if (!entry.second && entry.first->second != client) {
+                    return;
+                }
+                to_watch_.push_back(client->getFD());
+                blocked_lock.unlock();
 
-            if (socket_count == NADJIEB_MJPEG_STREAMER_SOCKET_ERROR) {
-                throw std::runtime_error("pollSockets() failed\n");
+                write_poller_.wakeup();
+                return;
             }
 
-            if (socket_count == 0) {
-                continue;
+            // The connection is broken: keep the client unscheduled for good,
+            // the listener closes it on hangup.
+            if (result == WriteResult::FAILED) {
+                return;
+            }
+
+            if (!client->finish()) {
+                return;
+            }
+        }
+    }
+
+    void watchWritable() {
+        nadjieb::utils::lowerThreadPriority(niceness_);
+        std::vector<PollEvent> events;
+        std::vector<SocketFD> to_watch;
+
+        // Without wakeup() newly blocked clients are picked up on a short timeout.
+        const int timeout = Poller::canWakeup() ? -1 : 10;
+
+        while (!end_publisher_) {
+            auto wait_timeout = timeout;
+            std::unique_lock<std::mutex> blocked_lock(blocked_mtx_);
+            to_watch.swap(to_watch_);
+#ifdef NADJIEB_MJPEG_STREAMER_ZEROCOPY
+            // Lingering clients are not polled; their completions are read on a tick.
+            lingering_.erase(
+                std::remove_if(
+                    lingering_.begin(),
+                    lingering_.end(),
+                    [](const std::shared_ptr<Client>& client) { return client->reapLingering(); }),
+                lingering_.end());
+            if (!lingering_.empty()) {
+                wait_timeout = ZEROCOPY_REAP_INTERVAL_MS;
+            }
+#endif
+            // Added under the lock: removeClient() either drops the descriptor
+            // from to_watch_ or runs after it is registered, never during.
+            for (auto sockfd : to_watch) {
+                write_poller_.add(sockfd, POLLER_WRITE);
             }
+            blocked_lock.unlock();
+            to_watch.clear();
 
-            if (payload.second.revents != POLLWRNORM) {
-                throw std::runtime_error("revents != POLLWRNORM\n");
+            if (write_poller_.wait(events, wait_timeout) == NADJIEB_MJPEG_STREAMER_SOCKET_ERROR) {
+                continue;
             }
 
-            sendViaSocket(payload.second.fd, res_str.c_str(), res_str.size(), 0);
+            for (const auto& event : events) {
+                write_poller_.remove(event.fd);
+
+                blocked_lock.lock();
+                auto it = blocked_.find(event.fd);
+                if (it == blocked_.end()) {
+                    blocked_lock.unlock();
+                    continue;
+                }
+
+                auto client = std::move(it->second);
+                blocked_.erase(it);
+                blocked_lock.unlock();
+
+                // An error may be a zero-copy completion on a healthy socket;
+                // the flush reads it or fails for real.
+                if (event.writable || event.error) {
+                    schedule(client);
+                }
+            }
         }
     }
 };
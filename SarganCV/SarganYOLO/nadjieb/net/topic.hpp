@@ -1,82 +1,236 @@
 #pragma once
 
+#include <nadjieb/net/client.hpp>
+#include <nadjieb/net/frame.hpp>
 #include <nadjieb/net/socket.hpp>
+#include <nadjieb/net/stats.hpp>
+#include <nadjieb/net/variant.hpp>
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
 #include <mutex>
 #include <shared_mutex>
 #include <string>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace nadjieb {
 namespace net {
+// Snapshot requests keep a lazy topic produced for this long after the last one.
+constexpr std::chrono::milliseconds SNAPSHOT_DEMAND_TIMEOUT(5000);
+
 class Topic {
    public:
-    void setBuffer(const std::string& buffer) {
+    uint64_t nextFrameId() { return ++frame_id_; }
+
+    // A frame (all its variants) went out to the clients of the topic.
+    void countPublished() { ++frames_published_; }
+
+    // Text topic of server-sent events instead of images.
+    void setEventStream() { event_stream_ = true; }
+
+    bool isEventStream() const { return event_stream_; }
+
+    // Media topic: a continuous stream of the given content type that clients
+    // join at a key frame, receiving the initialization segment first.
+    void setMedia(const std::string& content_type, std::shared_ptr<const std::string> init) {
         std::unique_lock lock(buffer_mtx_);
-        buffer_ = buffer;
+        media_type_ = content_type;
+        init_ = std::move(init);
     }
 
-    std::string getBuffer() {
+    std::string getMediaType() {
         std::shared_lock lock(buffer_mtx_);
-        return buffer_;
+        return media_type_;
     }
 
-    void addClient(const SocketFD& sockfd) {
-        std::unique_lock client_lock(client_by_sockfd_mtx_);
-        client_by_sockfd_[sockfd] = NADJIEB_MJPEG_STREAMER_POLLFD{sockfd, POLLWRNORM, 0};
+    std::shared_ptr<const std::string> getInit() {
+        std::shared_lock lock(buffer_mtx_);
+        return init_;
+    }
+
+    // A client joined and waits for a key frame; the encoder should make the
+    // next frame one instead of letting it wait for the end of the GOP.
+    void requestKeyFrame() { key_frame_requested_ = true; }
+
+    bool takeKeyFrameRequest() { return key_frame_requested_.exchange(false); }
+
+    bool hasKeyFrameRequest() const { return key_frame_requested_; }
+
+    void requestSnapshot() { snapshot_requested_ = std::chrono::steady_clock::now().time_since_epoch().count(); }
+
+    bool hasSnapshotDemand() {
+        auto requested = std::chrono::steady_clock::time_point(
+            std::chrono::steady_clock::duration(snapshot_requested_.load()));
+        return (requested.time_since_epoch().count() != 0)
+               && (std::chrono::steady_clock::now() - requested < SNAPSHOT_DEMAND_TIMEOUT);
+    }
+
+    void setBuffer(FramePtr buffer) {
+        std::unique_lock lock(buffer_mtx_);
+        buffer_ = std::move(buffer);
+    }
+
+    FramePtr getBuffer() {
+        std::shared_lock lock(buffer_mtx_);
+        return buffer_;
+    }
 
-        std::unique_lock queue_size_lock(queue_size_by_sockfd__mtx_);
-        queue_size_by_sockfd_[sockfd] = 0;
+    std::shared_ptr<Client> addClient(
+        const SocketFD& sockfd,
+        const Variant& variant = Variant(),
+        Transport transport = Transport::MULTIPART) {
+        auto client = std::make_shared<Client>(sockfd, transport);
+
+        std::unique_lock lock(clients_mtx_);
+        auto key = variant.key();
+        auto& group = groups_[key];
+        group.variant = variant;
+        group.clients[sockfd] = client;
+        group_by_sockfd_[sockfd] = key;
+        return client;
     }
 
-    void removeClient(const SocketFD& sockfd) {
-        std::unique_lock lock(client_by_sockfd_mtx_);
-        client_by_sockfd_.erase(sockfd);
+    std::shared_ptr<Client> removeClient(const SocketFD& sockfd) {
+        std::unique_lock lock(clients_mtx_);
+        auto group_it = group_by_sockfd_.find(sockfd);
+        if (group_it == group_by_sockfd_.end()) {
+            return nullptr;
+        }
+
+        auto it = groups_.find(group_it->second);
+        group_by_sockfd_.erase(group_it);
+        if (it == groups_.end()) {
+            return nullptr;
+        }
+
+        auto& clients = it->second.clients;
+        auto client_it = clients.find(sockfd);
+        if (client_it == clients.end()) {
+            return nullptr;
+        }
+
+        auto client = client_it->second;
+        clients.erase(client_it);
+
+        // Nobody watches the variant anymore, stop encoding it.
+        if (clients.empty()) {
+            groups_.erase(it);
+        }
 
-        std::unique_lock queue_size_lock(queue_size_by_sockfd__mtx_);
-        queue_size_by_sockfd_.erase(sockfd);
+        return client;
     }
 
     bool hasClient() {
-        std::shared_lock lock(client_by_sockfd_mtx_);
-        return !client_by_sockfd_.empty();
+        std::shared_lock lock(clients_mtx_);
+        return !group_by_sockfd_.empty();
     }
 
-    std::vector<NADJIEB_MJPEG_STREAMER_POLLFD> getClients() {
-        std::shared_lock lock(client_by_sockfd_mtx_);
+    bool hasClient(Transport transport) {
+        std::shared_lock lock(clients_mtx_);
+        for (const auto& group : groups_) {
+            for (const auto& client : group.second.clients) {
+                if (client.second->getTransport() == transport) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    size_t getClientCount() {
+        std::shared_lock lock(clients_mtx_);
+        return group_by_sockfd_.size();
+    }
+
+    std::vector<std::shared_ptr<Client>> getClients() {
+        std::shared_lock lock(clients_mtx_);
 
-        std::vector<NADJIEB_MJPEG_STREAMER_POLLFD> clients;
-        for (const auto& client : client_by_sockfd_) {
-            clients.push_back(client.second);
+        std::vector<std::shared_ptr<Client>> clients;
+        clients.reserve(group_by_sockfd_.size());
+        for (const auto& group : groups_) {
+            for (const auto& client : group.second.clients) {
+                clients.push_back(client.second);
+            }
         }
 
         return clients;
     }
 
-    int getQueueSize(const SocketFD& sockfd) {
-        std::shared_lock queue_size_lock(queue_size_by_sockfd__mtx_);
-        return queue_size_by_sockfd_[sockfd];
-    }
+    // Clients grouped by the variant they asked for; only watched variants.
+    std::vector<std::pair<Variant, std::vector<std::shared_ptr<Client>>>> getVariants() {
+        std::shared_lock lock(clients_mtx_);
+
+        std::vector<std::pair<Variant, std::vector<std::shared_ptr<Client>>>> variants;
+        variants.reserve(groups_.size());
+        for (const auto& group : groups_) {
+            variants.emplace_back(group.second.variant, std::vector<std::shared_ptr<Client>>());
+            auto& clients = variants.back().second;
+            clients.reserve(group.second.clients.size());
+            for (const auto& client : group.second.clients) {
+                clients.push_back(client.second);
+            }
+        }
 
-    void increaseQueue(const SocketFD& sockfd) {
-        std::unique_lock queue_size_lock(queue_size_by_sockfd__mtx_);
-        ++queue_size_by_sockfd_[sockfd];
+        return variants;
     }
 
-    void decreaseQueue(const SocketFD& sockfd) {
-        std::unique_lock queue_size_lock(queue_size_by_sockfd__mtx_);
-        --queue_size_by_sockfd_[sockfd];
+    // Counters of the topic and its clients; the caller fills in the path.
+    TopicStats getStats() {
+        TopicStats stats;
+        stats.event_stream = isEventStream();
+        stats.media_type = getMediaType();
+        stats.frames_published = frames_published_;
+
+        const auto now = std::chrono::steady_clock::now();
+        std::shared_lock lock(clients_mtx_);
+        stats.clients.reserve(group_by_sockfd_.size());
+        for (const auto& group : groups_) {
+            for (const auto& entry : group.second.clients) {
+                const auto& client = entry.second;
+                ClientStats client_stats;
+                client_stats.sockfd = entry.first;
+                client_stats.transport = client->getTransport();
+                client_stats.variant = group.first;
+                client_stats.max_fps = client->getMaxFps();
+                client_stats.frames_sent = client->getFramesSent();
+                client_stats.frames_dropped = client->getFramesDropped();
+                client_stats.frames_skipped = client->getFramesSkipped();
+                client_stats.bytes_sent = client->getBytesSent();
+                client_stats.queue_depth = client->getQueueDepth();
+                client_stats.connected_seconds
+                    = std::chrono::duration<double>(now - client->getConnectedAt()).count();
+                stats.clients.push_back(std::move(client_stats));
+            }
+        }
+
+        return stats;
     }
 
    private:
-    std::string buffer_;
+    std::atomic<uint64_t> frame_id_{0};
+    std::atomic<uint64_t> frames_published_{0};
+    std::atomic<bool> event_stream_{false};
+    std::atomic<bool> key_frame_requested_{false};
+    std::atomic<std::chrono::steady_clock::rep> snapshot_requested_{0};
+
+    FramePtr buffer_;
+    std::string media_type_;
+    std::shared_ptr<const std::string> init_;
     std::shared_mutex buffer_mtx_;
 
-    std::unordered_map<SocketFD, NADJIEB_MJPEG_STREAMER_POLLFD> client_by_sockfd_;
-    std::shared_mutex client_by_sockfd_mtx_;
+    struct Group {
+        Variant variant;
+        std::unordered_map<SocketFD, std::shared_ptr<Client>> clients;
+    };
 
-    std::unordered_map<SocketFD, int> queue_size_by_sockfd_;
-    std::shared_mutex queue_size_by_sockfd__mtx_;
+    // Groups by variant key, the default variant has an empty key.
+    std::unordered_map<std::string, Group> groups_;
+    std::unordered_map<SocketFD, std::string> group_by_sockfd_;
+    std::shared_mutex clients_mtx_;
 };
 }  // namespace net
 }  // namespace nadjieb
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <nadjieb/net/topic.hpp>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace nadjieb {
+namespace net {
+using TopicPtr = std::shared_ptr<Topic>;
+
+// Topics by path. Readers (listeners, producers, workers) take the current
+// snapshot of the map with std::atomic_load(), which holds a libstdc++ pool
+// mutex only for the pointer copy, never during a lookup; creating a topic
+// copies the map and swaps the snapshot in, which only happens once per path. Handles stay valid
+// after clear(), so a client or producer may keep its topic.
+class TopicRegistry {
+   public:
+    using Map = std::unordered_map<std::string, TopicPtr>;
+
+    TopicRegistry() : topics_(std::make_shared<const Map>()) {}
+
+    // The topic of the path, nullptr if it was never created. Never inserts.
+    TopicPtr find(const std::string& path) const {
+        auto topics = snapshot();
+        auto it = topics->find(path);
+        return (it == topics->end()) ? nullptr : it->second;
+    }
+
+    // The topic of the path, created on first use.
+    TopicPtr create(const std::string& path) {
+        auto topic = find(path);
+        if (topic) {
+            return topic;
+        }
+
+        std::unique_lock<std::mutex> lock(write_mtx_);
+        auto topics = snapshot();
+        auto it = topics->find(path);
+        if (it != topics->end()) {
+            return it->second;
+        }
+
+        auto copy = std::make_shared<Map>(*topics);
+        topic = std::make_shared<Topic>();
+        copy->emplace(path, topic);
+        std::atomic_store(&topics_, std::shared_ptr<const Map>(std::move(copy)));
+        return topic;
+    }
+
+    // Consistent view of all topics, e.g. for statistics.
+    std::shared_ptr<const Map> snapshot() const { return std::atomic_load(&topics_); }
+
+    void clear() {
+        std::unique_lock<std::mutex> lock(write_mtx_);
+        std::atomic_store(&topics_, std::make_shared<const Map>());
+    }
+
+   private:
+    std::shared_ptr<const Map> topics_;
+    std::mutex write_mtx_;
+};
+}  // namespace net
+}  // namespace nadjieb
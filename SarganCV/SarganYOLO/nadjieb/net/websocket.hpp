@@ -0,0 +1,203 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Reference https://datatracker.ietf.org/doc/html/rfc6455
+
+namespace nadjieb {
+namespace net {
+constexpr uint8_t WEBSOCKET_OPCODE_TEXT = 0x1;
+constexpr uint8_t WEBSOCKET_OPCODE_BINARY = 0x2;
+constexpr uint8_t WEBSOCKET_OPCODE_CLOSE = 0x8;
+constexpr uint8_t WEBSOCKET_OPCODE_PING = 0x9;
+constexpr uint8_t WEBSOCKET_OPCODE_PONG = 0xA;
+
+// Header of an unmasked, unfragmented server message carrying `size` bytes.
+inline std::string makeWebSocketHeader(uint8_t opcode, size_t size) {
+    std::string header;
+    header.push_back(char(0x80 | opcode));
+    if (size < 126) {
+        header.push_back(char(size));
+    } else if (size <= 0xFFFF) {
+        header.push_back(char(126));
+        header.push_back(char(size >> 8));
+        header.push_back(char(size & 0xFF));
+    } else {
+        header.push_back(char(127));
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            header.push_back(char((uint64_t(size) >> shift) & 0xFF));
+        }
+    }
+    return header;
+}
+
+// SHA-1 of the handshake only; it is not used for anything security related.
+inline std::string sha1(std::string_view message) {
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    auto rotl = [](uint32_t value, int bits) { return (value << bits) | (value >> (32 - bits)); };
+
+    std::string data(message);
+    const uint64_t bit_length = uint64_t(message.size()) * 8;
+    data.push_back(char(0x80));
+    while (data.size() % 64 != 56) {
+        data.push_back(0);
+    }
+    for (int shift = 56; shift >= 0; shift -= 8) {
+        data.push_back(char((bit_length >> shift) & 0xFF));
+    }
+
+    for (size_t chunk = 0; chunk < data.size(); chunk += 64) {
+        uint32_t w[80];
+        for (int i = 0; i < 16; ++i) {
+            const auto* p = reinterpret_cast<const uint8_t*>(data.data() + chunk + i * 4);
+            w[i] = (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+        }
+        for (int i = 16; i < 80; ++i) {
+            w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        }
+
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; ++i) {
+            uint32_t f, k;
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            } else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+
+            uint32_t temp = rotl(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = rotl(b, 30);
+            b = a;
+            a = temp;
+        }
+
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+
+    std::string digest;
+    for (auto value : h) {
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            digest.push_back(char((value >> shift) & 0xFF));
+        }
+    }
+    return digest;
+}
+
+inline std::string base64Encode(std::string_view data) {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    std::string encoded;
+    encoded.reserve((data.size() + 2) / 3 * 4);
+    for (size_t i = 0; i < data.size(); i += 3) {
+        uint32_t triple = uint32_t(uint8_t(data[i])) << 16;
+        if (i + 1 < data.size()) {
+            triple |= uint32_t(uint8_t(data[i + 1])) << 8;
+        }
+        if (i + 2 < data.size()) {
+            triple |= uint32_t(uint8_t(data[i + 2]));
+        }
+
+        encoded.push_back(alphabet[(triple >> 18) & 0x3F]);
+        encoded.push_back(alphabet[(triple >> 12) & 0x3F]);
+        encoded.push_back((i + 1 < data.size()) ? alphabet[(triple >> 6) & 0x3F] : '=');
+        encoded.push_back((i + 2 < data.size()) ? alphabet[triple & 0x3F] : '=');
+    }
+    return encoded;
+}
+
+// Value of Sec-WebSocket-Accept for the Sec-WebSocket-Key of a request.
+inline std::string computeWebSocketAccept(std::string_view key) {
+    std::string accept_key(key);
+    accept_key += "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+    return base64Encode(sha1(accept_key));
+}
+
+// Follows the messages a browser sends on an upgraded connection. The payloads
+// are skipped, only the opcodes matter: the streamer does not take input, it
+// only has to notice a close.
+class WebSocketReader {
+   public:
+    // Feeds received bytes; returns true once a close frame (or a frame that
+    // breaks the protocol) has been seen.
+    bool consume(const char* data, size_t size) {
+        while (size > 0) {
+            if (remaining_ > 0) {
+                auto skip = (remaining_ < size) ? size_t(remaining_) : size;
+                remaining_ -= skip;
+                data += skip;
+                size -= skip;
+                continue;
+            }
+
+            header_[header_size_++] = uint8_t(*data++);
+            --size;
+
+            // Frames from a client are always masked.
+            if (header_size_ >= 2 && !(header_[1] & 0x80)) {
+                return true;
+            }
+
+            auto needed = headerSize();
+            if (header_size_ < needed) {
+                continue;
+            }
+
+            const auto opcode = header_[0] & 0x0F;
+            if (opcode == WEBSOCKET_OPCODE_CLOSE) {
+                return true;
+            }
+
+            remaining_ = payloadSize();
+            header_size_ = 0;
+        }
+
+        return false;
+    }
+
+   private:
+    uint8_t header_[14];
+    size_t header_size_ = 0;
+    uint64_t remaining_ = 0;
+
+    size_t headerSize() const {
+        if (header_size_ < 2) {
+            return 2;
+        }
+
+        const auto length = header_[1] & 0x7F;
+        return 2 + ((length == 126) ? 2 : (length == 127) ? 8 : 0) + 4;
+    }
+
+    uint64_t payloadSize() const {
+        const auto length = header_[1] & 0x7F;
+        if (length < 126) {
+            return length;
+        }
+
+        uint64_t size = 0;
+        const size_t bytes = (length == 126) ? 2 : 8;
+        for (size_t i = 0; i < bytes; ++i) {
+            size = (size << 8) | header_[2 + i];
+        }
+        return size;
+    }
+};
+}  // namespace net
+}  // namespace nadjieb
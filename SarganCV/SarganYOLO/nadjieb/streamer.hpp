@@ -29,23 +29,72 @@ SOFTWARE.
 
 #include <nadjieb/utils/version.hpp>
 
+#include <nadjieb/net/connection_limiter.hpp>
+#include <nadjieb/net/frame.hpp>
 #include <nadjieb/net/http_request.hpp>
 #include <nadjieb/net/http_response.hpp>
 #include <nadjieb/net/listener.hpp>
 #include <nadjieb/net/publisher.hpp>
 #include <nadjieb/net/socket.hpp>
+#include <nadjieb/net/stats.hpp>
+#include <nadjieb/net/variant.hpp>
+#include <nadjieb/net/websocket.hpp>
 #include <nadjieb/utils/non_copyable.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace nadjieb {
+// Connections and subscriptions refused by the admission limits.
+struct AdmissionStats {
+    uint64_t rejected_connections = 0;
+    uint64_t rejected_per_ip = 0;
+    uint64_t rejected_subscribers = 0;
+};
+
+// Counters of all topics and their clients. Frames published but not sent to a
+// client were dropped for its slow connection or skipped for its ?fps= limit.
+struct StreamerStats {
+    std::vector<nadjieb::net::TopicStats> topics;
+    AdmissionStats admission;
+};
+
 class MJPEGStreamer : public nadjieb::utils::NonCopyable {
    public:
     virtual ~MJPEGStreamer() { stop(); }
 
-    void start(int port, int num_workers = std::thread::hardware_concurrency()) {
+    // With several listeners (Linux only) each listener thread binds the port with
+    // SO_REUSEPORT and serves the connections the kernel hands to it; topics and
+    // admission limits are shared.
+    void start(int port, int num_workers = std::thread::hardware_concurrency(), int num_listeners = 1) {
+#ifndef NADJIEB_MJPEG_STREAMER_REUSEPORT
+        num_listeners = 1;
+#endif
+        num_listeners = std::max(num_listeners, 1);
+
         publisher_.start(num_workers);
-        listener_.withOnMessageCallback(on_message_cb_).withOnBeforeCloseCallback(on_before_close_cb_).runAsync(port);
+
+        listeners_.clear();
+        for (auto i = 0; i < num_listeners; ++i) {
+            listeners_.emplace_back(new nadjieb::net::Listener());
+            listeners_.back()
+                ->withOnMessageCallback(on_message_cb_)
+                .withOnBeforeCloseCallback(on_before_close_cb_)
+                .withConnectionLimiter(limiter_)
+                .withSendBufferSize(send_buffer_size_)
+                .withNiceness(niceness_)
+                .withReusePort(num_listeners > 1)
+                .runAsync(port);
+        }
 
         while (!isRunning()) {
             std::this_thread::sleep_for(std::chrono::milliseconds(10));
@@ -54,28 +103,342 @@ class MJPEGStreamer : public nadjieb::utils::NonCopyable {
 
     void stop() {
         publisher_.stop();
-        listener_.stop();
+        for (auto& listener : listeners_) {
+            listener->stop();
+        }
     }
 
+    // Registers the path before its first frame, so clients can subscribe to it
+    // instead of getting 404. Publishing registers the path as well.
+    void createTopic(const std::string& path) { publisher_.createTopic(path); }
+
     void publish(const std::string& path, const std::string& buffer) { publisher_.enqueue(path, buffer); }
 
+    // Takes over the buffer: the frame is shared by all clients without copies.
+    // The metadata (e.g. detections as JSON) reaches WebSocket clients of the path
+    // as a text message following the frame; multipart clients get the image only.
+    // The frame number and capture time from the pipeline go to the X-Frame-Id and
+    // X-Capture-Timestamp headers of each multipart part, next to
+    // X-Publish-Timestamp; without them the number within the topic and the
+    // publish time are used.
+    void publish(
+        const std::string& path,
+        std::string&& buffer,
+        std::string&& metadata = std::string(),
+        const nadjieb::net::FrameInfo& info = nadjieb::net::FrameInfo()) {
+        publisher_.enqueue(path, std::move(buffer), std::move(metadata), info);
+    }
+
+    // Lazy topic: the producer encodes the frame only if somebody is watching the
+    // path. An empty result skips the frame. Returns true if a frame was published.
+    // Clients may limit their frame rate with "path?fps=2": they skip frames in
+    // between, and a frame no client is due for is not produced at all.
+    bool publish(
+        const std::string& path,
+        const std::function<std::string()>& producer,
+        const std::string& metadata = std::string(),
+        const nadjieb::net::FrameInfo& info = nadjieb::net::FrameInfo()) {
+        return publisher_.enqueue(path, producer, metadata, info);
+    }
+
+    // Lazy topic with variants: clients may ask for "path?scale=0.5&q=60" and the
+    // producer is called once per watched variant. Plain buffers and producers
+    // without a variant argument send the same frame to every client of the path.
+    bool publish(
+        const std::string& path,
+        const std::function<std::string(const nadjieb::net::Variant&)>& producer,
+        const std::string& metadata = std::string(),
+        const nadjieb::net::FrameInfo& info = nadjieb::net::FrameInfo()) {
+        return publisher_.enqueue(path, producer, metadata, info);
+    }
+
+    // Event topic: clients get text/event-stream with one event per call, e.g.
+    // detections as JSON. Returns true if somebody was listening.
+    bool publishEvent(const std::string& path, const std::string& data) { return publisher_.enqueueEvent(path, data); }
+
+    // Media topic (e.g. H.264 in fragmented MP4): one encoder output shared by
+    // all clients. The initialization segment registers the topic; fragments are
+    // published as they come, each client starts at a key frame.
+    void setMediaInit(const std::string& path, const std::string& content_type, const std::string& init) {
+        publisher_.setMediaInit(path, content_type, init);
+    }
+
+    bool publishMedia(const std::string& path, const std::string& fragment, bool key_frame) {
+        return publisher_.enqueueMedia(path, fragment, key_frame);
+    }
+
+    // A client joined the media topic; the next fragment should be a key frame.
+    bool needsKeyFrame(const std::string& path) { return publisher_.needsKeyFrame(path); }
+
     void setShutdownTarget(const std::string& target) { shutdown_target_ = target; }
 
-    bool isRunning() { return (publisher_.isRunning() && listener_.isRunning()); }
+    // Transmission tuning, set before start(). Frames of at least `threshold` bytes
+    // are sent with MSG_ZEROCOPY on Linux (0 disables); a non-zero send buffer size
+    // replaces the kernel autotuning of SO_SNDBUF.
+    void setZeroCopyThreshold(size_t threshold) { publisher_.setZeroCopyThreshold(threshold); }
+
+    void setSendBufferSize(int size) { send_buffer_size_ = size; }
+
+    // Admission limits, set before start(); 0 means no limit. Requests over a
+    // limit get 503 instead of a stream.
+    void setConnectionLimits(size_t max_connections, size_t max_connections_per_ip, size_t max_subscribers_per_topic) {
+        limiter_->setLimits(max_connections, max_connections_per_ip);
+        max_subscribers_per_topic_ = max_subscribers_per_topic;
+    }
+
+    // Lowers the priority of the streamer threads (1..19, set before start()), so
+    // viewers cannot take the CPU from the application producing the frames.
+    void setNiceness(int niceness) {
+        niceness_ = niceness;
+        publisher_.setNiceness(niceness);
+    }
+
+    AdmissionStats getAdmissionStats() {
+        AdmissionStats stats;
+        stats.rejected_connections = limiter_->getRejectedConnections();
+        stats.rejected_per_ip = limiter_->getRejectedPerIP();
+        stats.rejected_subscribers = rejected_subscribers_;
+        return stats;
+    }
+
+    StreamerStats getStats() {
+        StreamerStats stats;
+        stats.topics = publisher_.getStats();
+        stats.admission = getAdmissionStats();
+        return stats;
+    }
+
+    // The statistics as JSON are served on this target ("/stats" by default),
+    // an empty target disables it.
+    void setStatsTarget(const std::string& target) { stats_target_ = target; }
+
+    // A topic path with this suffix ("/sargan.jpg" by default) returns the latest
+    // frame of the topic once instead of a stream.
+    void setSnapshotSuffix(const std::string& suffix) { snapshot_suffix_ = suffix; }
+
+    bool isRunning() {
+        if (!publisher_.isRunning() || listeners_.empty()) {
+            return false;
+        }
+
+        for (auto& listener : listeners_) {
+            if (!listener->isRunning()) {
+                return false;
+            }
+        }
+
+        return true;
+    }
 
     bool hasClient(const std::string& path) { return publisher_.hasClient(path); }
 
+    // Only clients of the transport, e.g. WebSocket viewers that take the metadata.
+    bool hasClient(const std::string& path, nadjieb::net::Transport transport) {
+        return publisher_.hasClient(path, transport);
+    }
+
+    // Serves a single response generated by the handler on each request of the target.
+    void addEndpoint(
+        const std::string& target,
+        const std::string& content_type,
+        const std::function<std::string()>& handler) {
+        std::unique_lock<std::mutex> lock(endpoints_mtx_);
+        endpoints_[target] = std::make_pair(content_type, handler);
+    }
+
    private:
-    nadjieb::net::Listener listener_;
+    std::vector<std::unique_ptr<nadjieb::net::Listener>> listeners_;
+    std::shared_ptr<nadjieb::net::ConnectionLimiter> limiter_ = std::make_shared<nadjieb::net::ConnectionLimiter>();
+    int send_buffer_size_ = 0;
+    int niceness_ = 0;
     nadjieb::net::Publisher publisher_;
     std::string shutdown_target_ = "/shutdown";
+    std::string stats_target_ = "/stats";
+    std::string snapshot_suffix_ = ".jpg";
+    size_t max_subscribers_per_topic_ = 0;
+    std::atomic<uint64_t> rejected_subscribers_{0};
+    std::unordered_map<std::string, std::pair<std::string, std::function<std::string()>>> endpoints_;
+    std::mutex endpoints_mtx_;
+
+    bool findEndpoint(const std::string& target, std::pair<std::string, std::function<std::string()>>& endpoint) {
+        std::unique_lock<std::mutex> lock(endpoints_mtx_);
+        auto it = endpoints_.find(target);
+        if (it == endpoints_.end()) {
+            return false;
+        }
+
+        endpoint = it->second;
+        return true;
+    }
+
+    // A topic path requested with "Upgrade: websocket" is streamed as WebSocket
+    // messages instead of multipart parts.
+    static bool isWebSocketUpgrade(const nadjieb::net::HTTPRequest& req) {
+        auto upgrade = req.getValue("Upgrade");
+        if (upgrade.size() != 9) {
+            return false;
+        }
+
+        for (size_t i = 0; i < upgrade.size(); ++i) {
+            auto c = (upgrade[i] >= 'A' && upgrade[i] <= 'Z') ? char(upgrade[i] - 'A' + 'a') : upgrade[i];
+            if (c != "websocket"[i]) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // Returns true if the handshake succeeded and the connection is upgraded.
+    bool acceptWebSocket(const nadjieb::net::SocketFD& sockfd, const nadjieb::net::HTTPRequest& req) {
+        auto key = req.getValue("Sec-WebSocket-Key");
+
+        nadjieb::net::HTTPResponse websocket_res;
+        websocket_res.setVersion(req.getVersion());
+        if (key.empty() || req.getValue("Sec-WebSocket-Version") != "13") {
+            websocket_res.setStatusCode(426);
+            websocket_res.setStatusText("Upgrade Required");
+            websocket_res.setValue("Sec-WebSocket-Version", "13");
+            websocket_res.setValue("Content-Length", "0");
+            auto websocket_res_str = websocket_res.serialize();
+
+            nadjieb::net::sendViaSocket(sockfd, websocket_res_str.c_str(), websocket_res_str.size(), 0);
+            return false;
+        }
+
+        websocket_res.setStatusCode(101);
+        websocket_res.setStatusText("Switching Protocols");
+        websocket_res.setValue("Upgrade", "websocket");
+        websocket_res.setValue("Connection", "Upgrade");
+        websocket_res.setValue("Sec-WebSocket-Accept", nadjieb::net::computeWebSocketAccept(key));
+        auto websocket_res_str = websocket_res.serialize();
+
+        nadjieb::net::sendViaSocket(sockfd, websocket_res_str.c_str(), websocket_res_str.size(), 0);
+        return true;
+    }
+
+    static std::string toJsonString(const std::string& value) {
+        std::string json = "\"";
+        for (auto c : value) {
+            if (c == '"' || c == '\\') {
+                json += '\\';
+                json += c;
+            } else if ((unsigned char)c < 0x20) {
+                char escaped[8];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned)c);
+                json += escaped;
+            } else {
+                json += c;
+            }
+        }
+        json += "\"";
+        return json;
+    }
+
+    static std::string toJson(const StreamerStats& stats) {
+        std::string json = "{\"topics\":[";
+        for (size_t i = 0; i < stats.topics.size(); ++i) {
+            const auto& topic = stats.topics[i];
+            json += (i > 0) ? ",{" : "{";
+            json += "\"path\":" + toJsonString(topic.path);
+            json += ",\"type\":";
+            json += topic.event_stream ? "\"events\"" : (topic.media_type.empty() ? "\"images\"" : "\"media\"");
+            json += ",\"frames_published\":" + std::to_string(topic.frames_published);
+            json += ",\"clients\":[";
+            for (size_t j = 0; j < topic.clients.size(); ++j) {
+                const auto& client = topic.clients[j];
+                char connected[32];
+                snprintf(connected, sizeof(connected), "%.3f", client.connected_seconds);
+                char max_fps[32];
+                snprintf(max_fps, sizeof(max_fps), "%g", client.max_fps);
+
+                json += (j > 0) ? ",{" : "{";
+                json += "\"fd\":" + std::to_string(client.sockfd);
+                json += ",\"transport\":\"" + std::string(nadjieb::net::transportName(client.transport)) + "\"";
+                json += ",\"variant\":" + toJsonString(client.variant);
+                json += ",\"max_fps\":" + std::string(max_fps);
+                json += ",\"frames_sent\":" + std::to_string(client.frames_sent);
+                json += ",\"frames_dropped\":" + std::to_string(client.frames_dropped);
+                json += ",\"frames_skipped\":" + std::to_string(client.frames_skipped);
+                json += ",\"bytes_sent\":" + std::to_string(client.bytes_sent);
+                json += ",\"queue_depth\":" + std::to_string(client.queue_depth);
+                json += ",\"connected_seconds\":" + std::string(connected);
+                json += "}";
+            }
+            json += "]}";
+        }
+        json += "],\"admission\":{";
+        json += "\"rejected_connections\":" + std::to_string(stats.admission.rejected_connections);
+        json += ",\"rejected_per_ip\":" + std::to_string(stats.admission.rejected_per_ip);
+        json += ",\"rejected_subscribers\":" + std::to_string(stats.admission.rejected_subscribers);
+        json += "}}";
+        return json;
+    }
+
+    bool isSnapshot(const std::string& path) {
+        return (!snapshot_suffix_.empty() && path.size() > snapshot_suffix_.size()
+                && path.compare(path.size() - snapshot_suffix_.size(), snapshot_suffix_.size(), snapshot_suffix_) == 0
+                && publisher_.pathExists(path.substr(0, path.size() - snapshot_suffix_.size()))
+                && !publisher_.isEventStream(path.substr(0, path.size() - snapshot_suffix_.size()))
+                && publisher_.getMediaType(path.substr(0, path.size() - snapshot_suffix_.size())).empty());
+    }
+
+    // Returns true if the response is complete and the connection can be closed.
+    bool sendSnapshot(
+        const nadjieb::net::SocketFD& sockfd,
+        const nadjieb::net::HTTPRequest& req,
+        const std::string& path) {
+        auto frame = publisher_.getSnapshot(path);
+
+        nadjieb::net::HTTPResponse snapshot_res;
+        snapshot_res.setVersion(req.getVersion());
+        snapshot_res.setValue("Connection", "close");
+        snapshot_res.setValue("Cache-Control", "no-cache");
+
+        // A lazy topic starts producing on the first request.
+        if (!frame) {
+            snapshot_res.setStatusCode(503);
+            snapshot_res.setStatusText("Service Unavailable");
+            snapshot_res.setValue("Retry-After", "1");
+            snapshot_res.setValue("Content-Length", "0");
+            auto snapshot_res_str = snapshot_res.serialize();
+
+            nadjieb::net::sendViaSocket(sockfd, snapshot_res_str.c_str(), snapshot_res_str.size(), 0);
+            return true;
+        }
+
+        auto frame_id = std::to_string(frame->getId());
+        auto etag = "\"" + frame_id + "\"";
+        snapshot_res.setValue("ETag", etag);
+        snapshot_res.setValue("X-Frame-Id", frame_id);
+        snapshot_res.setValue("X-Capture-Timestamp", frame->getCaptureTime().toHeaderValue());
+        snapshot_res.setValue("X-Publish-Timestamp", frame->getPublishTime().toHeaderValue());
+
+        if (req.getValue("If-None-Match") == etag) {
+            snapshot_res.setStatusCode(304);
+            snapshot_res.setStatusText("Not Modified");
+            auto snapshot_res_str = snapshot_res.serialize();
+
+            nadjieb::net::sendViaSocket(sockfd, snapshot_res_str.c_str(), snapshot_res_str.size(), 0);
+            return true;
+        }
+
+        snapshot_res.setStatusCode(200);
+        snapshot_res.setStatusText("OK");
+        snapshot_res.setValue("Content-Type", "image/jpeg");
+        snapshot_res.setValue("Content-Length", std::to_string(frame->getBuffer().size()));
+
+        // The body is sent from the cached frame without copying it.
+        publisher_.respond(sockfd, snapshot_res.serialize(), frame);
+        return false;
+    }
 
     nadjieb::net::OnMessageCallback on_message_cb_ = [&](const nadjieb::net::SocketFD& sockfd,
-                                                         const std::string& message) {
-        nadjieb::net::HTTPRequest req(message);
+                                                         const nadjieb::net::HTTPRequest& req) {
         nadjieb::net::OnMessageCallbackResponse cb_res;
+        auto path = std::string(req.getPath());
 
-        if (req.getTarget() == shutdown_target_) {
+        if (path == shutdown_target_) {
             nadjieb::net::HTTPResponse shutdown_res;
             shutdown_res.setVersion(req.getVersion());
             shutdown_res.setStatusCode(200);
@@ -104,7 +467,37 @@ class MJPEGStreamer : public nadjieb::utils::NonCopyable {
             return cb_res;
         }
 
-        if (!publisher_.pathExists(req.getTarget())) {
+        std::pair<std::string, std::function<std::string()>> endpoint;
+        if (!stats_target_.empty() && path == stats_target_) {
+            endpoint = std::make_pair("application/json", [&]() { return toJson(getStats()); });
+        }
+
+        if (endpoint.second || findEndpoint(path, endpoint)) {
+            auto body = endpoint.second();
+
+            nadjieb::net::HTTPResponse endpoint_res;
+            endpoint_res.setVersion(req.getVersion());
+            endpoint_res.setStatusCode(200);
+            endpoint_res.setStatusText("OK");
+            endpoint_res.setValue("Connection", "close");
+            endpoint_res.setValue("Cache-Control", "no-cache, no-store, must-revalidate");
+            endpoint_res.setValue("Content-Type", endpoint.first);
+            endpoint_res.setValue("Content-Length", std::to_string(body.size()));
+            endpoint_res.setBody(body);
+            auto endpoint_res_str = endpoint_res.serialize();
+
+            nadjieb::net::sendViaSocket(sockfd, endpoint_res_str.c_str(), endpoint_res_str.size(), 0);
+
+            cb_res.close_conn = true;
+            return cb_res;
+        }
+
+        if (isSnapshot(path)) {
+            cb_res.close_conn = sendSnapshot(sockfd, req, path.substr(0, path.size() - snapshot_suffix_.size()));
+            return cb_res;
+        }
+
+        if (!publisher_.pathExists(path)) {
             nadjieb::net::HTTPResponse not_found_res;
             not_found_res.setVersion(req.getVersion());
             not_found_res.setStatusCode(404);
@@ -117,6 +510,78 @@ class MJPEGStreamer : public nadjieb::utils::NonCopyable {
             return cb_res;
         }
 
+        if (max_subscribers_per_topic_ > 0 && publisher_.getClientCount(path) >= max_subscribers_per_topic_) {
+            ++rejected_subscribers_;
+
+            nadjieb::net::HTTPResponse unavailable_res;
+            unavailable_res.setVersion(req.getVersion());
+            unavailable_res.setStatusCode(503);
+            unavailable_res.setStatusText("Service Unavailable");
+            unavailable_res.setValue("Retry-After", "5");
+            unavailable_res.setValue("Content-Length", "0");
+            auto unavailable_res_str = unavailable_res.serialize();
+
+            nadjieb::net::sendViaSocket(sockfd, unavailable_res_str.c_str(), unavailable_res_str.size(), 0);
+
+            cb_res.close_conn = true;
+            return cb_res;
+        }
+
+        if (publisher_.isEventStream(path)) {
+            nadjieb::net::HTTPResponse events_res;
+            events_res.setVersion(req.getVersion());
+            events_res.setStatusCode(200);
+            events_res.setStatusText("OK");
+            events_res.setValue("Connection", "close");
+            events_res.setValue("Cache-Control", "no-cache, no-store, must-revalidate");
+            events_res.setValue("Content-Type", "text/event-stream");
+            // Browsers reconnect after a second if the stream breaks.
+            events_res.setBody("retry: 1000\n\n");
+            auto events_res_str = events_res.serialize();
+
+            nadjieb::net::sendViaSocket(sockfd, events_res_str.c_str(), events_res_str.size(), 0);
+
+            publisher_.add(sockfd, path, nadjieb::net::Variant(), nadjieb::net::Transport::EVENT_STREAM);
+
+            return cb_res;
+        }
+
+        auto media_type = publisher_.getMediaType(path);
+        if (!media_type.empty()) {
+            nadjieb::net::HTTPResponse media_res;
+            media_res.setVersion(req.getVersion());
+            media_res.setStatusCode(200);
+            media_res.setStatusText("OK");
+            media_res.setValue("Connection", "close");
+            media_res.setValue("Cache-Control", "no-cache, no-store, must-revalidate");
+            media_res.setValue("Content-Type", media_type);
+            media_res.setValue("Transfer-Encoding", "chunked");
+            auto media_res_str = media_res.serialize();
+
+            nadjieb::net::sendViaSocket(sockfd, media_res_str.c_str(), media_res_str.size(), 0);
+
+            publisher_.add(sockfd, path, nadjieb::net::Variant(), nadjieb::net::Transport::MEDIA);
+
+            return cb_res;
+        }
+
+        if (isWebSocketUpgrade(req)) {
+            if (!acceptWebSocket(sockfd, req)) {
+                cb_res.close_conn = true;
+                return cb_res;
+            }
+
+            publisher_.add(
+                sockfd,
+                path,
+                nadjieb::net::Variant::fromQuery(req.getQuery()),
+                nadjieb::net::Transport::WEBSOCKET,
+                nadjieb::net::maxFpsFromQuery(req.getQuery()));
+
+            cb_res.upgraded = true;
+            return cb_res;
+        }
+
         nadjieb::net::HTTPResponse init_res;
         init_res.setVersion(req.getVersion());
         init_res.setStatusCode(200);
@@ -129,7 +594,12 @@ class MJPEGStreamer : public nadjieb::utils::NonCopyable {
 
         nadjieb::net::sendViaSocket(sockfd, init_res_str.c_str(), init_res_str.size(), 0);
 
-        publisher_.add(sockfd, req.getTarget());
+        publisher_.add(
+            sockfd,
+            path,
+            nadjieb::net::Variant::fromQuery(req.getQuery()),
+            nadjieb::net::Transport::MULTIPART,
+            nadjieb::net::maxFpsFromQuery(req.getQuery()));
 
         return cb_res;
     };
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <atomic>
+
 namespace nadjieb {
 namespace utils {
 enum class State { UNSPECIFIED = 0, NEW, BOOTING, RUNNING, TERMINATING, TERMINATED };
@@ -10,7 +12,8 @@ class Runnable {
     bool isRunning() { return (state_ == State::RUNNING); }
 
    protected:
-    State state_ = State::NEW;
+    // Read by other threads, e.g. while waiting for start().
+    std::atomic<State> state_{State::NEW};
 };
 }  // namespace utils
 }  // namespace nadjieb
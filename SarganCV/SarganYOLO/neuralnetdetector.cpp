@@ -76,6 +76,7 @@ error_t NeuralNetDetector::init_network(const std::string model_path, const std:
 #endif
     if (err == 0)
     {
+        model_file = model_path;
         network = cv::dnn::readNetFromONNX(model_path);
         if (network.empty())
         {
@@ -120,26 +121,62 @@ std::vector<cv::Mat> NeuralNetDetector::pre_process(cv::Mat &img, cv::dnn::Net &
     return outputs;
 }
 
-cv::Mat NeuralNetDetector::post_process(cv::Mat &img, std::vector<cv::Mat> &outputs, const std::vector<std::string> &class_name) {
-    // Initialize vectors to hold respective outputs while unwrapping detections.
-    cv::Mat ret = img.clone();
-    classes_id_set.clear();
-    confidences_set.clear();
-    boxes_set.clear();
-    classes_set.clear();
-    std::vector<int> class_ids;
-    std::vector<float> confidences;
-    std::vector<cv::Rect> boxes;
+std::vector<cv::Mat> NeuralNetDetector::pre_process_tiles(cv::Mat &img, cv::dnn::Net &net)
+{
+    // Convert all tiles to a single batched blob.
+    std::vector<cv::Mat> crops;
+    for (const cv::Rect &tile : tiles)
+        crops.push_back(img(tile));
+    cv::Mat blob;
+    cv::dnn::blobFromImages(crops, blob, 1.0 / 255.0, cv::Size(input_width, input_height), cv::Scalar(), true, false);
+    net.setInput(blob);
+    // Forward propagate.
+    std::vector<cv::Mat> outputs;
+    net.forward(outputs, net.getUnconnectedOutLayersNames());
+    return outputs;
+}
+
+void NeuralNetDetector::make_tiles(const cv::Size &frame)
+{
+    tiles.clear();
+
+    int tile_w = std::min(tile_size, frame.width);
+    int tile_h = std::min(tile_size, frame.height);
+    int stride = std::max(1, (int)(tile_size * (1.0f - tile_overlap)));
+
+    // Tiles are spread evenly so that the last one ends at the frame border.
+    int nx = frame.width > tile_w ? (frame.width - tile_w + stride - 1) / stride + 1 : 1;
+    int ny = frame.height > tile_h ? (frame.height - tile_h + stride - 1) / stride + 1 : 1;
+
+    for (int iy = 0; iy < ny; ++iy)
+    {
+        int y = ny > 1 ? iy * (frame.height - tile_h) / (ny - 1) : 0;
+        for (int ix = 0; ix < nx; ++ix)
+        {
+            int x = nx > 1 ? ix * (frame.width - tile_w) / (nx - 1) : 0;
+            tiles.push_back(cv::Rect(x, y, tile_w, tile_h));
+        }
+    }
+
+    // Whole frame keeps large (near) targets that are cut by tile borders.
+    if (TILE_FULL_FRAME && tiles.size() > 1)
+        tiles.push_back(cv::Rect(0, 0, frame.width, frame.height));
+}
+
+void NeuralNetDetector::decode(cv::Mat &output, int batch, const cv::Rect &region)
+{
+    // Output shape is [batch, rows, 5 + classes].
+    const size_t rows = output.size[1];
+    const size_t dimensions = output.size[2];
+    const int num_classes = (int)dimensions - 5;
 
     // Resizing factor.
-    float x_factor = img.cols / (float)input_width;
-    float y_factor = img.rows / (float)input_height;
+    float x_factor = region.width / (float)input_width;
+    float y_factor = region.height / (float)input_height;
 
-    float *data = (float *)outputs[0].data;
+    float *data = (float *)output.data + batch * rows * dimensions;
 
-    const size_t dimensions = class_name.size() + 5;
-    const size_t rows = 25200;
-    // Iterate through 25200 detections.
+    // Iterate through all detections (25200 for 640x640).
     for (size_t i = 0; i < rows; ++i)
     {
         float confidence = data[4];
@@ -148,7 +185,7 @@ cv::Mat NeuralNetDetector::post_process(cv::Mat &img, std::vector<cv::Mat> &outp
         {
             float * classes_scores = data + 5;
             // Create a 1x85 Mat and store class scores of 80 classes.
-            cv::Mat scores(1, (int)class_name.size(), CV_32FC1, classes_scores);
+            cv::Mat scores(1, num_classes, CV_32FC1, classes_scores);
             // Perform minMaxLoc and acquire index of best class score.
             cv::Point class_id;
             double max_class_score;
@@ -165,9 +202,9 @@ cv::Mat NeuralNetDetector::post_process(cv::Mat &img, std::vector<cv::Mat> &outp
                 // Box dimension.
                 float w = data[2];
                 float h = data[3];
-                // Bounding box coordinates.
-                int left = int((cx - 0.5 * w) * x_factor);
-                int top = int((cy - 0.5 * h) * y_factor);
+                // Bounding box coordinates (in frame coordinates).
+                int left = region.x + int((cx - 0.5 * w) * x_factor);
+                int top = region.y + int((cy - 0.5 * h) * y_factor);
                 int width = int(w * x_factor);
                 int height = int(h * y_factor);
                 // Store good detections in the boxes vector.
@@ -177,31 +214,57 @@ cv::Mat NeuralNetDetector::post_process(cv::Mat &img, std::vector<cv::Mat> &outp
         // Jump to the next column.
         data += dimensions;
     }
+}
 
-    // Perform Non Maximum Suppression and draw predictions.
-    std::vector<int> indices;
-    cv::dnn::NMSBoxes(boxes, confidences, SCORE_THRESHOLD, NMS_THRESHOLD, indices);
+cv::Mat NeuralNetDetector::post_process(cv::Mat &img, const std::vector<std::string> &class_name) {
+    // Initialize vectors to hold respective outputs.
+    cv::Mat ret = img.clone();
+    classes_id_set.clear();
+    confidences_set.clear();
+    boxes_set.clear();
+    classes_set.clear();
+    all_class_ids.clear();
+    all_boxes.clear();
+    all_confidences.clear();
+    all_classes.clear();
 
-    int bigestArea = INT_MIN;
+    // Perform Non Maximum Suppression and find the biggest target.
     int bigestIndex = -1;
-    int boxIndex = -1;
 
-    for (size_t i = 0; i < indices.size(); i++)
+    if (NMS_SINGLE_TARGET && !all_detections)
     {
-        int idx = indices[i];
-        cv::Rect box = boxes[idx];
+        bigestIndex = nms.largest(boxes, confidences, class_ids);
+    }
+    else
+    {
+        nms.suppress(boxes, confidences, class_ids, nms_indices);
 
-        boxIndex++;
-        if (box.area() > bigestArea)
+        int bigestArea = INT_MIN;
+        for (int idx : nms_indices)
         {
-            bigestIndex = boxIndex;
-            bigestArea = box.area();
+            if (boxes[idx].area() > bigestArea)
+            {
+                bigestIndex = idx;
+                bigestArea = boxes[idx].area();
+            }
+        }
+
+        // Every survivor, the target included, for the stream metadata.
+        if (all_detections)
+        {
+            for (int idx : nms_indices)
+            {
+                all_boxes.push_back(boxes[idx]);
+                all_confidences.push_back(confidences[idx]);
+                all_class_ids.push_back(class_ids[idx]);
+                all_classes.push_back(class_name[class_ids[idx]]);
+            }
         }
     }
 
     if (bigestIndex > -1)
     {
-        int idx = indices[bigestIndex];
+        int idx = bigestIndex;
         cv::Rect box = boxes[idx];
 
         boxes_set.push_back(box);
@@ -230,15 +293,149 @@ cv::Mat NeuralNetDetector::post_process(cv::Mat &img, std::vector<cv::Mat> &outp
 
 cv::Mat NeuralNetDetector::process(cv::Mat &img)
 {
-    std::vector<cv::Mat> detections;
-    detections = pre_process(img, network);
-    cv::Mat res = post_process(img, detections, NeuralNetDetector::classes);
-    // Put efficiency information.
+    class_ids.clear();
+    confidences.clear();
+    boxes.clear();
+
+    if (!tiled)
+    {
+        std::vector<cv::Mat> detections = pre_process(img, network);
+        decode(detections[0], 0, cv::Rect(0, 0, img.cols, img.rows));
+        NeuralNetDetector::inference_time = forward_time();
+    }
+    else
+    {
+        make_tiles(img.size());
+        NeuralNetDetector::inference_time = 0;
+
+        if (tile_batching)
+        {
+            bool batched = false;
+            try
+            {
+                // All tiles in one forward pass.
+                std::vector<cv::Mat> detections = pre_process_tiles(img, network);
+                // A model exported with batch 1 may return a single image for
+                // the whole blob without an error.
+                cv::Mat &output = detections[0];
+                if (output.dims == 3 && output.size[0] >= (int)tiles.size())
+                {
+                    for (size_t i = 0; i < tiles.size(); i++)
+                        decode(output, (int)i, tiles[i]);
+                    NeuralNetDetector::inference_time = forward_time();
+                    batched = true;
+                }
+            }
+            catch (const cv::Exception &)
+            {
+                // Same fallback as a short batch.
+            }
+
+            if (!batched)
+            {
+                // The model was exported with a fixed batch size.
+                if (DIAGNOSTIC_LOG)
+                    std::cerr << "Batched tiles are not supported by the model, falling back to sequential tiles" << std::endl;
+                tile_batching = false;
+                class_ids.clear();
+                confidences.clear();
+                boxes.clear();
+            }
+        }
+
+        if (!tile_batching)
+        {
+            for (const cv::Rect &tile : tiles)
+            {
+                cv::Mat crop = img(tile);
+                std::vector<cv::Mat> detections = pre_process(crop, network);
+                decode(detections[0], 0, tile);
+                NeuralNetDetector::inference_time += forward_time();
+            }
+        }
+    }
+
+    // Cross-tile Non Maximum Suppression and drawing.
+    return post_process(img, NeuralNetDetector::classes);
+}
+
+int NeuralNetDetector::set_input_sizes(std::vector<int> sizes)
+{
+    std::sort(sizes.begin(), sizes.end());
+    networks.clear();
+    input_sizes.clear();
+
+    for (int size : sizes)
+    {
+        // A separate network per size keeps its buffers allocated, so
+        // switching the resolution does not cost a reallocation.
+        cv::dnn::Net net = cv::dnn::readNetFromONNX(model_file);
+        if (net.empty())
+            continue;
+        net.setPreferableBackend(cv::dnn::DNN_BACKEND_DEFAULT);
+        net.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
+
+        try
+        {
+            // Warm-up pass.
+            cv::Mat blob;
+            cv::Mat dummy(size, size, CV_8UC3, cv::Scalar());
+            cv::dnn::blobFromImage(dummy, blob, 1.0 / 255.0, cv::Size(size, size), cv::Scalar(), true, false);
+            net.setInput(blob);
+            std::vector<cv::Mat> outputs;
+            net.forward(outputs, net.getUnconnectedOutLayersNames());
+        }
+        catch (const cv::Exception &)
+        {
+            // The model was exported with a fixed input shape.
+            if (DIAGNOSTIC_LOG)
+                std::cerr << "Input size " << size << " is not supported by the model" << std::endl;
+            continue;
+        }
+
+        networks.push_back(net);
+        input_sizes.push_back(cv::Size(size, size));
+    }
+
+    if (networks.empty())
+    {
+        input_sizes.push_back(cv::Size(input_width, input_height));
+        return 1;
+    }
+
+    set_input_level((int)networks.size() - 1);
+    return (int)networks.size();
+}
+
+void NeuralNetDetector::set_input_level(int level)
+{
+    if (networks.empty())
+        return;
+
+    input_level = std::min(std::max(level, 0), (int)networks.size() - 1);
+    network = networks[input_level];
+    input_width = input_sizes[input_level].width;
+    input_height = input_sizes[input_level].height;
+}
+
+float NeuralNetDetector::forward_time(void)
+{
     // The function getPerfProfile returns the overall time for inference(t) and the timings for each of the layers(in layersTimes)
     std::vector<double> layersTimes;
     double freq = cv::getTickFrequency();
-    NeuralNetDetector::inference_time = network.getPerfProfile(layersTimes) / (float)freq;
-    return res;
+    float t = network.getPerfProfile(layersTimes) / (float)freq;
+    if (profiler)
+        profiler->add(network, layersTimes, cv::Size(input_width, input_height));
+    return t;
+}
+
+void NeuralNetDetector::set_tiling(bool enabled, int size, float overlap)
+{
+    tiled = enabled;
+    tile_size = std::max(size, 32);
+    tile_overlap = std::min(std::max(overlap, 0.0f), 0.9f);
+    tile_batching = true;
+    tiles.clear();
 }
 
 std::string NeuralNetDetector::get_info(void)
@@ -4,6 +4,10 @@
 #include <opencv2/opencv.hpp>
 #include <opencv2/dnn.hpp>
 
+#include "fastnms.h"
+#include "layerprofiler.h"
+
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <cerrno>
@@ -13,6 +17,14 @@ static const float SCORE_THRESHOLD      = 0.50f;
 static const float NMS_THRESHOLD        = 0.45f;
 static const float CONFIDENCE_THRESHOLD = 0.45f;
 
+/** Параметры NMS */
+static const int  NMS_TOP_K         = 300;   // Максимум кандидатов, попадающих в NMS
+static const bool NMS_CLASS_AWARE   = false; // Подавление только внутри одного класса
+static const bool NMS_SINGLE_TARGET = true;  // Нужна только самая крупная цель (быстрый путь)
+
+/** Добавлять весь кадр к набору тайлов (для крупных близких целей) */
+static const bool TILE_FULL_FRAME = true;
+
 /** Параметры шрифтов */
 static const float FONT_SCALE = 0.7f;
 static const int   THICKNESS  = 1;
@@ -36,15 +48,41 @@ private:
     /** Ширина и высота входного изображения */
     int input_width = 640;
     int input_height = 640;
+    /** Подготовленные экземпляры сети для разных входных разрешений */
+    std::string model_file;
+    std::vector<cv::dnn::Net> networks;
+    std::vector<cv::Size> input_sizes;
+    int input_level = 0;
     /** Вектор распознаваемых классов */
     std::vector<std::string> classes;
+    /** Кандидаты, найденные сетью (до NMS) */
+    std::vector<int> class_ids;
+    std::vector<float> confidences;
+    std::vector<cv::Rect> boxes;
     /** Структуры для хранения результатов обработки */
     std::vector<int> classes_id_set;
     std::vector<cv::Rect> boxes_set;
     std::vector<float> confidences_set;
     std::vector<std::string> classes_set;
+    /** Все детекции после NMS (для метаданных), если они запрошены */
+    bool all_detections = false;
+    std::vector<int> all_class_ids;
+    std::vector<cv::Rect> all_boxes;
+    std::vector<float> all_confidences;
+    std::vector<std::string> all_classes;
     /** Время обработки */
     float inference_time;
+    /** Профилировщик слоев (необязательный) */
+    LayerProfiler *profiler = nullptr;
+    /** Подавление немаксимумов */
+    FastNMS nms{SCORE_THRESHOLD, NMS_THRESHOLD, NMS_TOP_K, NMS_CLASS_AWARE};
+    std::vector<int> nms_indices;
+    /** Режим обработки кадра тайлами с перекрытием */
+    bool tiled = false;
+    int tile_size = 640;
+    float tile_overlap = 0.2f;
+    bool tile_batching = true;
+    std::vector<cv::Rect> tiles;
 
 #ifdef _WIN32
     /** Получить строковые значения классов */
@@ -62,8 +100,16 @@ private:
     void draw_label(cv::Mat& img, std::string label, int left, int top);
     /** Предобработка результатов */
     std::vector<cv::Mat> pre_process(cv::Mat &img, cv::dnn::Net &net);
+    /** Предобработка тайлов одним батчем */
+    std::vector<cv::Mat> pre_process_tiles(cv::Mat &img, cv::dnn::Net &net);
+    /** Разбиение кадра на тайлы */
+    void make_tiles(const cv::Size &frame);
+    /** Декодирование выхода сети в кандидаты (координаты области region) */
+    void decode(cv::Mat &output, int batch, const cv::Rect &region);
+    /** Время последнего прогона сети, с (с учетом в профилировщике) */
+    float forward_time(void);
     /** Постобработка результатов */
-    cv::Mat post_process(cv::Mat &img, std::vector<cv::Mat> &outputs, const std::vector<std::string> &class_name);
+    cv::Mat post_process(cv::Mat &img, const std::vector<std::string> &class_name);
 public:
     NeuralNetDetector(const std::string model, const std::string classes);
     NeuralNetDetector(const std::string model, const std::string classes, int width, int height);
@@ -71,8 +117,27 @@ public:
     std::vector<cv::Rect> get_boxes(void) { return boxes_set; }
     std::vector<int> get_class_ids(void) { return classes_id_set; }
     std::vector<std::string> get_classes(void) { return classes_set; }
+    /** Сохранять все детекции после NMS, а не только цель
+     *   В режиме NMS_SINGLE_TARGET это включает полный NMS для кадра.
+     */
+    void set_all_detections(bool enabled) { all_detections = enabled; }
+    std::vector<int> get_all_class_ids(void) { return all_class_ids; }
+    std::vector<cv::Rect> get_all_boxes(void) { return all_boxes; }
+    std::vector<float> get_all_confidences(void) { return all_confidences; }
+    std::vector<std::string> get_all_classes(void) { return all_classes; }
     float get_inference(void) { return inference_time; }
+    int get_tiles(void) { return tiled ? (int)tiles.size() : 1; }
     std::string get_info(void);
+    /** Подготовить сеть для набора входных разрешений (по возрастанию), вернуть число уровней */
+    int set_input_sizes(std::vector<int> sizes);
+    /** Выбрать входное разрешение по номеру уровня */
+    void set_input_level(int level);
+    std::vector<cv::Size> get_input_sizes(void) { return input_sizes; }
+    cv::Size get_input_size(void) { return cv::Size(input_width, input_height); }
+    /** Подключение профилировщика слоев */
+    void set_profiler(LayerProfiler *layer_profiler) { profiler = layer_profiler; }
+    /** Включение тайлового режима: размер тайла в пикселях кадра и доля перекрытия */
+    void set_tiling(bool enabled, int size, float overlap);
     cv::Mat process(cv::Mat &img);
 };
 
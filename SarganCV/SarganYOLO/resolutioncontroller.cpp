@@ -0,0 +1,94 @@
+#include "resolutioncontroller.h"
+
+#include <fstream>
+
+ResolutionController::ResolutionController(double budget_ms, const std::vector<cv::Size> &sizes)
+{
+    this->budget_ms = budget_ms;
+    for (const cv::Size &size : sizes)
+        costs.push_back((double)size.area());
+    // Start from the largest size and step down if it does not fit.
+    level = (int)costs.size() - 1;
+}
+
+void ResolutionController::switch_level(int next)
+{
+    // Inference time scales with the input area, the rest of the frame does not.
+    double fixed = frame_ewma - inference_ewma;
+    inference_ewma *= costs[next] / costs[level];
+    frame_ewma = fixed + inference_ewma;
+
+    level = next;
+    hold = RES_HOLD_FRAMES;
+    up_count = 0;
+}
+
+bool ResolutionController::check_thermal(void)
+{
+#ifndef _WIN32
+    if (thermal_count++ % RES_THERMAL_PERIOD != 0)
+        return hot;
+
+    std::ifstream zone(RES_THERMAL_ZONE);
+    long millidegrees;
+    if (zone >> millidegrees)
+    {
+        double celsius = millidegrees / 1000.0;
+        // Hysteresis: cool down 5 degrees below the limit before stepping up again.
+        if (celsius > RES_THERMAL_LIMIT)
+            hot = true;
+        else if (celsius < RES_THERMAL_LIMIT - 5)
+            hot = false;
+    }
+#endif
+    return hot;
+}
+
+int ResolutionController::update(double frame_ms, double inference_ms)
+{
+    if (costs.size() < 2 || budget_ms <= 0)
+        return level;
+
+    if (frame_ewma == 0)
+    {
+        frame_ewma = frame_ms;
+        inference_ewma = inference_ms;
+    }
+    else
+    {
+        frame_ewma = RES_EWMA_ALPHA * frame_ms + (1 - RES_EWMA_ALPHA) * frame_ewma;
+        inference_ewma = RES_EWMA_ALPHA * inference_ms + (1 - RES_EWMA_ALPHA) * inference_ewma;
+    }
+
+    bool overheated = check_thermal();
+
+    if (hold > 0)
+    {
+        hold--;
+        return level;
+    }
+
+    // Over budget or throttling: step down right away.
+    if ((frame_ewma > budget_ms || overheated) && level > 0)
+    {
+        switch_level(level - 1);
+        return level;
+    }
+
+    // Step up only if the predicted time fits with headroom for a while.
+    if (level + 1 < (int)costs.size() && !overheated)
+    {
+        double predicted = frame_ewma - inference_ewma + inference_ewma * costs[level + 1] / costs[level];
+        if (predicted < budget_ms * RES_UP_HEADROOM)
+        {
+            if (++up_count >= RES_UP_FRAMES)
+                switch_level(level + 1);
+        }
+        else
+        {
+            up_count = 0;
+        }
+    }
+
+    return level;
+}
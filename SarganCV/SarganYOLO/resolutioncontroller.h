@@ -0,0 +1,56 @@
+#ifndef RESOLUTIONCONTROLLER_H
+#define RESOLUTIONCONTROLLER_H
+
+#include <opencv2/opencv.hpp>
+
+#include <string>
+#include <vector>
+
+/** Параметры регулятора разрешения */
+static const double RES_EWMA_ALPHA     = 0.2;  // Коэф-т сглаживания времени кадра
+static const double RES_UP_HEADROOM    = 0.8;  // Повышение только с запасом по бюджету
+static const int    RES_UP_FRAMES      = 30;   // Кадров подряд до повышения разрешения
+static const int    RES_HOLD_FRAMES    = 10;   // Пауза после переключения
+static const int    RES_THERMAL_PERIOD = 30;   // Период опроса датчика температуры (кадры)
+static const double RES_THERMAL_LIMIT  = 80.0; // Температура троттлинга, °C
+static const std::string RES_THERMAL_ZONE = "/sys/class/thermal/thermal_zone0/temp";
+
+/** Регулятор входного разрешения сети по бюджету времени кадра
+ *   Выбирает наибольшее из подготовленных разрешений, при котором сглаженное
+ *   время обработки кадра укладывается в бюджет. При превышении бюджета или
+ *   перегреве процессора разрешение понижается сразу, повышение выполняется
+ *   только по прогнозу с запасом после серии стабильных кадров.
+ */
+class ResolutionController
+{
+private:
+    /** Бюджет времени кадра, мс */
+    double budget_ms;
+    /** Относительная стоимость инференса на каждом уровне (площадь входа) */
+    std::vector<double> costs;
+    /** Текущий уровень */
+    int level;
+    /** Сглаженное время кадра и инференса, мс */
+    double frame_ewma = 0;
+    double inference_ewma = 0;
+    /** Счетчики гистерезиса */
+    int up_count = 0;
+    int hold = 0;
+    /** Состояние датчика температуры */
+    int thermal_count = 0;
+    bool hot = false;
+
+    /** Переход на уровень с пересчетом прогноза времени */
+    void switch_level(int next);
+    /** Проверка перегрева процессора */
+    bool check_thermal(void);
+public:
+    ResolutionController(double budget_ms, const std::vector<cv::Size> &sizes);
+    /** Учесть время очередного кадра, вернуть уровень для следующего */
+    int update(double frame_ms, double inference_ms);
+    int get_level(void) { return level; }
+    double get_frame_time(void) { return frame_ewma; }
+    bool is_hot(void) { return hot; }
+};
+
+#endif // RESOLUTIONCONTROLLER_H